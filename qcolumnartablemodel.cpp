@@ -0,0 +1,447 @@
+#include "qcolumnartablemodel.h"
+#include <QStringList>
+#include <QVector>
+
+#include <algorithm>
+
+/*
+ * Storage of one column. Only the vector of the column type is used; the strings of a
+ * column are stored back to back in one character arena.
+ */
+struct QColumnarTableColumn
+{
+    QColumnarTableColumn(QColumnarTableModel::ColumnType t = QColumnarTableModel::Int64Column) : type(t) {}
+
+    int rowCount() const;
+    void reserve(int rows);
+    void clear();
+    void append(const QColumnarTableColumn &other);
+
+    QColumnarTableModel::ColumnType type;
+    QVector<qint64> integers;
+    QVector<double> doubles;
+    QVector<QChar> characters;
+    QVector<int> ends;          // end of every string in characters
+};
+
+int QColumnarTableColumn::rowCount() const
+{
+    switch (type) {
+    case QColumnarTableModel::Int64Column:
+        return integers.size();
+    case QColumnarTableModel::DoubleColumn:
+        return doubles.size();
+    case QColumnarTableModel::StringColumn:
+        return ends.size();
+    }
+    return 0;
+}
+
+void QColumnarTableColumn::reserve(int rows)
+{
+    switch (type) {
+    case QColumnarTableModel::Int64Column:
+        integers.reserve(rows);
+        break;
+    case QColumnarTableModel::DoubleColumn:
+        doubles.reserve(rows);
+        break;
+    case QColumnarTableModel::StringColumn:
+        ends.reserve(rows);
+        break;
+    }
+}
+
+void QColumnarTableColumn::clear()
+{
+    integers.clear();
+    doubles.clear();
+    characters.clear();
+    ends.clear();
+}
+
+void QColumnarTableColumn::append(const QColumnarTableColumn &other)
+{
+    Q_ASSERT(type == other.type);
+    switch (type) {
+    case QColumnarTableModel::Int64Column:
+        integers += other.integers;
+        break;
+    case QColumnarTableModel::DoubleColumn:
+        doubles += other.doubles;
+        break;
+    case QColumnarTableModel::StringColumn: {
+        const int base = characters.size();
+        characters += other.characters;
+        ends.reserve(ends.size() + other.ends.size());
+        foreach (int end, other.ends) {
+            ends.append(base + end);
+        }
+        break;
+    }
+    }
+}
+
+class QColumnarTableBatchData : public QSharedData
+{
+public:
+    QVector<QColumnarTableColumn> columns;
+};
+
+/*!
+    \class QColumnarTableBatch
+    \brief The QColumnarTableBatch class collects rows to be appended to a QColumnarTableModel at once.
+
+    A batch is created by QColumnarTableModel::createBatch() and is filled column by column.
+    Values of a wrong type for the column are ignored; such a batch is rejected by
+    QColumnarTableModel::appendBatch() because its columns differ in length.
+*/
+
+/*!
+ * \brief Constructs an empty batch without columns.
+ */
+QColumnarTableBatch::QColumnarTableBatch() :
+    d(new QColumnarTableBatchData)
+{
+}
+
+QColumnarTableBatch::QColumnarTableBatch(const QColumnarTableBatch &other) :
+    d(other.d)
+{
+}
+
+QColumnarTableBatch::~QColumnarTableBatch()
+{
+}
+
+QColumnarTableBatch &QColumnarTableBatch::operator=(const QColumnarTableBatch &other)
+{
+    d = other.d;
+    return *this;
+}
+
+int QColumnarTableBatch::columnCount() const
+{
+    return d->columns.size();
+}
+
+/*!
+ * \return Returns the number of values appended to the given \a column.
+ */
+int QColumnarTableBatch::rowCount(int column) const
+{
+    return d->columns.at(column).rowCount();
+}
+
+/*!
+ * \brief Reserves space for the given number of \a rows in every column.
+ */
+void QColumnarTableBatch::reserve(int rows)
+{
+    for (int i = 0; i < d->columns.size(); ++i) {
+        d->columns[i].reserve(rows);
+    }
+}
+
+/*!
+ * \brief Removes all values, so the batch can be filled again.
+ */
+void QColumnarTableBatch::clear()
+{
+    for (int i = 0; i < d->columns.size(); ++i) {
+        d->columns[i].clear();
+    }
+}
+
+void QColumnarTableBatch::appendInt64(int column, qint64 value)
+{
+    QColumnarTableColumn &data = d->columns[column];
+    Q_ASSERT(data.type == QColumnarTableModel::Int64Column);
+    if (data.type == QColumnarTableModel::Int64Column) {
+        data.integers.append(value);
+    }
+}
+
+void QColumnarTableBatch::appendDouble(int column, double value)
+{
+    QColumnarTableColumn &data = d->columns[column];
+    Q_ASSERT(data.type == QColumnarTableModel::DoubleColumn);
+    if (data.type == QColumnarTableModel::DoubleColumn) {
+        data.doubles.append(value);
+    }
+}
+
+void QColumnarTableBatch::appendString(int column, const QString &value)
+{
+    QColumnarTableColumn &data = d->columns[column];
+    Q_ASSERT(data.type == QColumnarTableModel::StringColumn);
+    if (data.type == QColumnarTableModel::StringColumn) {
+        const int begin = data.characters.size();
+        data.characters.resize(begin + value.size());
+        std::copy(value.unicode(), value.unicode() + value.size(), data.characters.begin() + begin);
+        data.ends.append(data.characters.size());
+    }
+}
+
+class QColumnarTableModelPrivate
+{
+    QColumnarTableModel *const q_ptr;
+    Q_DECLARE_PUBLIC(QColumnarTableModel)
+
+    QColumnarTableModelPrivate(QColumnarTableModel *qptr) : q_ptr(qptr), m_rowCount(0), m_directRead(true) {}
+
+    QStringList m_names;
+    QVector<QColumnarTableColumn> m_columns;
+    int m_rowCount;
+    bool m_directRead;
+};
+
+/*!
+    \class QColumnarTableModel
+    \brief The QColumnarTableModel class provides an append-only table with typed columns.
+    \ingroup model-view
+
+    Every column is stored contiguously, strings are kept in one character arena per column,
+    so appending rows does not allocate per row. Rows are added by batches; every batch is
+    announced with a single rowsInserted() signal.
+
+    QMultiProxyModel recognizes this model and reads the display and edit roles through value()
+    and the numeric columns directly, without creating a source index, as long as
+    isDirectReadEnabled() is true. Subclasses that reimplement data() for these roles must
+    disable the direct reads with setDirectReadEnabled(false), otherwise their data() is bypassed.
+    \sa QColumnarTableBatch, QMultiProxyModel
+*/
+
+/*!
+ * \brief Constructs an empty model without columns with the given parent.
+ */
+QColumnarTableModel::QColumnarTableModel(QObject *parent) :
+    QAbstractTableModel(parent),
+    d_ptr(new QColumnarTableModelPrivate(this))
+{
+
+}
+
+/*!
+ * \brief Destroys the model.
+ */
+QColumnarTableModel::~QColumnarTableModel()
+{
+    delete d_ptr;
+}
+
+/*!
+ * \brief Appends a column with the given \a name and \a type.
+ * Existing rows get zero or an empty string in the new column.
+ * \return Returns the index of the new column.
+ */
+int QColumnarTableModel::addColumn(const QString &name, ColumnType type)
+{
+    Q_D(QColumnarTableModel);
+    const int column = d->m_columns.size();
+
+    QColumnarTableColumn data(type);
+    switch (type) {
+    case Int64Column:
+        data.integers = QVector<qint64>(d->m_rowCount, 0);
+        break;
+    case DoubleColumn:
+        data.doubles = QVector<double>(d->m_rowCount, 0.0);
+        break;
+    case StringColumn:
+        data.ends = QVector<int>(d->m_rowCount, 0);
+        break;
+    }
+
+    beginInsertColumns(QModelIndex(), column, column);
+    d->m_columns.append(data);
+    d->m_names.append(name);
+    endInsertColumns();
+    return column;
+}
+
+QColumnarTableModel::ColumnType QColumnarTableModel::columnType(int column) const
+{
+    Q_D(const QColumnarTableModel);
+    return d->m_columns.at(column).type;
+}
+
+QString QColumnarTableModel::columnName(int column) const
+{
+    Q_D(const QColumnarTableModel);
+    return d->m_names.value(column);
+}
+
+/*!
+ * \brief Returns an empty batch with the columns of the model.
+ */
+QColumnarTableBatch QColumnarTableModel::createBatch() const
+{
+    Q_D(const QColumnarTableModel);
+    QColumnarTableBatch batch;
+    foreach (const QColumnarTableColumn &column, d->m_columns) {
+        batch.d->columns.append(QColumnarTableColumn(column.type));
+    }
+    return batch;
+}
+
+/*!
+ * \brief Appends the rows of the given \a batch to the end of the model.
+ * \return Returns false if the batch does not match the columns of the model or its columns differ in length; otherwise returns true.
+ */
+bool QColumnarTableModel::appendBatch(const QColumnarTableBatch &batch)
+{
+    Q_D(QColumnarTableModel);
+    const QVector<QColumnarTableColumn> &columns = batch.d->columns;
+    if (columns.isEmpty() || columns.size() != d->m_columns.size()) {
+        return false;
+    }
+
+    const int rows = columns.first().rowCount();
+    for (int i = 0; i < columns.size(); ++i) {
+        if (columns.at(i).type != d->m_columns.at(i).type || columns.at(i).rowCount() != rows) {
+            return false;
+        }
+    }
+    if (rows == 0) {
+        return true;
+    }
+
+    beginInsertRows(QModelIndex(), d->m_rowCount, d->m_rowCount + rows - 1);
+    for (int i = 0; i < columns.size(); ++i) {
+        d->m_columns[i].append(columns.at(i));
+    }
+    d->m_rowCount += rows;
+    endInsertRows();
+    return true;
+}
+
+/*!
+ * \brief Removes all rows. The columns are kept.
+ * \note The model will be reseted.
+ */
+void QColumnarTableModel::clear()
+{
+    Q_D(QColumnarTableModel);
+    beginResetModel();
+    for (int i = 0; i < d->m_columns.size(); ++i) {
+        d->m_columns[i].clear();
+    }
+    d->m_rowCount = 0;
+    endResetModel();
+}
+
+/*!
+ * \brief Returns the value in the given \a row and \a column, or an invalid QVariant if there is no such cell.
+ * This is what data() returns for the display and edit roles.
+ */
+QVariant QColumnarTableModel::value(int row, int column) const
+{
+    Q_D(const QColumnarTableModel);
+    if (row < 0 || row >= d->m_rowCount || column < 0 || column >= d->m_columns.size()) {
+        return QVariant();
+    }
+
+    const QColumnarTableColumn &data = d->m_columns.at(column);
+    switch (data.type) {
+    case Int64Column:
+        return data.integers.at(row);
+    case DoubleColumn:
+        return data.doubles.at(row);
+    case StringColumn: {
+        const int begin = row > 0 ? data.ends.at(row - 1) : 0;
+        return QString(data.characters.constData() + begin, data.ends.at(row) - begin);
+    }
+    }
+    return QVariant();
+}
+
+/*!
+ * \return Returns the values of the given \a column, or 0 if it's not an Int64Column.
+ * The pointer is invalidated by the next append.
+ */
+const qint64 *QColumnarTableModel::int64Column(int column) const
+{
+    Q_D(const QColumnarTableModel);
+    if (column < 0 || column >= d->m_columns.size() || d->m_columns.at(column).type != Int64Column) {
+        return 0;
+    }
+    return d->m_columns.at(column).integers.constData();
+}
+
+/*!
+ * \return Returns the values of the given \a column, or 0 if it's not a DoubleColumn.
+ * The pointer is invalidated by the next append.
+ */
+const double *QColumnarTableModel::doubleColumn(int column) const
+{
+    Q_D(const QColumnarTableModel);
+    if (column < 0 || column >= d->m_columns.size() || d->m_columns.at(column).type != DoubleColumn) {
+        return 0;
+    }
+    return d->m_columns.at(column).doubles.constData();
+}
+
+/*!
+ * \return Returns true if the display and edit roles may be read through value(), int64Column()
+ * and doubleColumn() instead of data(). This is the default.
+ * \sa setDirectReadEnabled()
+ */
+bool QColumnarTableModel::isDirectReadEnabled() const
+{
+    Q_D(const QColumnarTableModel);
+    return d->m_directRead;
+}
+
+/*!
+ * \brief Allows or forbids reading the display and edit roles through value(), int64Column() and doubleColumn().
+ *
+ * Subclasses that reimplement data() for the display or edit role must call setDirectReadEnabled(false),
+ * usually in their constructor. QMultiProxyModel checks the flag when the model is added to it.
+ */
+void QColumnarTableModel::setDirectReadEnabled(bool enabled)
+{
+    Q_D(QColumnarTableModel);
+    d->m_directRead = enabled;
+}
+
+/*!
+ * \brief reimplemented QAbstractTableModel::rowCount
+ */
+int QColumnarTableModel::rowCount(const QModelIndex &parent) const
+{
+    Q_D(const QColumnarTableModel);
+    return parent.isValid() ? 0 : d->m_rowCount;
+}
+
+/*!
+ * \brief reimplemented QAbstractTableModel::columnCount
+ */
+int QColumnarTableModel::columnCount(const QModelIndex &parent) const
+{
+    Q_D(const QColumnarTableModel);
+    return parent.isValid() ? 0 : d->m_columns.size();
+}
+
+/*!
+ * \brief reimplemented QAbstractTableModel::data
+ */
+QVariant QColumnarTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole)) {
+        return QVariant();
+    }
+    return value(index.row(), index.column());
+}
+
+/*!
+ * \brief reimplemented QAbstractTableModel::headerData
+ */
+QVariant QColumnarTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    Q_D(const QColumnarTableModel);
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole && section >= 0 && section < d->m_names.size()) {
+        return d->m_names.at(section);
+    }
+    return QAbstractTableModel::headerData(section, orientation, role);
+}
@@ -0,0 +1,71 @@
+#ifndef QCOLUMNARTABLEMODEL_H
+#define QCOLUMNARTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QSharedDataPointer>
+
+class QColumnarTableModelPrivate;
+class QColumnarTableBatchData;
+
+class QColumnarTableBatch
+{
+public:
+    QColumnarTableBatch();
+    QColumnarTableBatch(const QColumnarTableBatch &other);
+    ~QColumnarTableBatch();
+    QColumnarTableBatch &operator=(const QColumnarTableBatch &other);
+
+    int columnCount() const;
+    int rowCount(int column) const;
+    void reserve(int rows);
+    void clear();
+
+    void appendInt64(int column, qint64 value);
+    void appendDouble(int column, double value);
+    void appendString(int column, const QString &value);
+
+private:
+    QSharedDataPointer<QColumnarTableBatchData> d;
+    friend class QColumnarTableModel;
+};
+
+class QColumnarTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum ColumnType {
+        Int64Column,
+        DoubleColumn,
+        StringColumn
+    };
+
+    explicit QColumnarTableModel(QObject *parent = 0);
+    virtual ~QColumnarTableModel();
+
+    int addColumn(const QString &name, ColumnType type);
+    ColumnType columnType(int column) const;
+    QString columnName(int column) const;
+
+    QColumnarTableBatch createBatch() const;
+    bool appendBatch(const QColumnarTableBatch &batch);
+    void clear();
+
+    QVariant value(int row, int column) const;
+    const qint64 *int64Column(int column) const;
+    const double *doubleColumn(int column) const;
+    bool isDirectReadEnabled() const;
+
+    virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    virtual int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+protected:
+    void setDirectReadEnabled(bool enabled);
+
+private:
+    QColumnarTableModelPrivate *const d_ptr;
+    Q_DECLARE_PRIVATE(QColumnarTableModel)
+};
+
+#endif // QCOLUMNARTABLEMODEL_H
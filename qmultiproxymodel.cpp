@@ -1,21 +1,357 @@
 #include "qmultiproxymodel.h"
+#include "qcolumnartablemodel.h"
 #include <QDebug>
 #include <QItemSelection>
+#include <QAbstractListModel>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QDateTime>
+#include <QPair>
+#include <QPersistentModelIndex>
+#include <QSet>
+#include <QThread>
+#include <QVector>
+#include <qnumeric.h>
+
+#include <algorithm>
+
+/*
+ * Number of rows summarized by one aggregate block. A changed row only
+ * requires its block to be recomputed.
+ */
+static const int AggregateBlockSize = 1024;
+
+/*
+ * Distance between the order labels of consecutive rows of a deduplicated source when they are
+ * labeled afresh, and the least distance a range of rows is relabeled to when inserted rows
+ * find no room between their neighbours.
+ */
+static const qint64 DedupLabelSpacing = Q_INT64_C(1) << 24;
+static const qint64 DedupMinimumLabelGap = Q_INT64_C(1) << 12;
+
+/*
+ * Number of independent accumulators of an aggregate block. Floating point additions can't be
+ * reordered, so the block is reduced in interleaved lanes that the compiler can map to vector registers.
+ */
+static const int AggregateLanes = 4;
+
+/*
+ * Source row provided by a proxy row in the interleaved layout.
+ */
+struct QMultiProxyModelInterleaveRow
+{
+    QMultiProxyModelInterleaveRow(int s = -1, int r = -1) : source(s), row(r) {}
+
+    int source;
+    int row;
+};
+Q_DECLARE_TYPEINFO(QMultiProxyModelInterleaveRow, Q_MOVABLE_TYPE);
+
+class QMultiProxyModelSnapshotData
+{
+public:
+    QMultiProxyModelSnapshotData() : ref(0) {}
+
+    mutable QAtomicInt ref;                 // number of snapshot handles
+    QList<QAbstractItemModel *> sourceModels;
+    QVector<bool> concurrentReadSafe;
+    QVector<int> offsets;                   // proxy offset of every source followed by the row count
+    // The row mappings are implicitly shared with the proxy model, whose next change of a
+    // mapping therefore copies it: O(rows of the source) when deduplicating and O(all rows)
+    // when interleaving, at most once per published snapshot.
+    QList<QVector<qint64> > labels;         // order labels of the source rows, empty unless deduplicating
+    QList<QVector<qint64> > visibleLabels;  // labels of the exposed source rows, empty unless deduplicating
+    QVector<QMultiProxyModelInterleaveRow> interleaved; // proxy row order, empty unless interleaving
+};
+
+/*
+ * Stands in for a deferred source model until it's materialized. The placeholder answers
+ * rowCount() with the estimate and asks the proxy model to materialize the source
+ * as soon as any of its rows is read.
+ */
+class QMultiProxyModelPlaceholder : public QAbstractListModel
+{
+public:
+    QMultiProxyModelPlaceholder(QMultiProxyModelDeferredSource *source, QMultiProxyModel *proxy) :
+        QAbstractListModel(proxy),
+        m_source(source),
+        m_proxy(proxy),
+        m_rowCount(qMax(source->estimatedRowCount(), 0)),
+        m_columnCount(qMax(source->estimatedColumnCount(), 1)),
+        m_requested(false)
+    {
+    }
+
+    QMultiProxyModelDeferredSource *deferredSource() const { return m_source; }
+    bool isRequested() const { return m_requested; }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const
+    {
+        return parent.isValid() ? 0 : m_rowCount;
+    }
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const
+    {
+        return parent.isValid() ? 0 : m_columnCount;
+    }
+
+    QVariant data(const QModelIndex &index, int role) const
+    {
+        Q_UNUSED(index)
+        Q_UNUSED(role)
+        if (!m_requested) {
+            m_requested = true;
+            QMetaObject::invokeMethod(m_proxy, "_q_materializeRequested", Qt::QueuedConnection);
+        }
+        return QVariant();
+    }
+
+private:
+    QMultiProxyModelDeferredSource *const m_source;
+    QMultiProxyModel *const m_proxy;
+    const int m_rowCount;
+    const int m_columnCount;
+    mutable bool m_requested;
+};
+
+// Sequentially consistent loads. The snapshot handshake stores one variable and then loads
+// the other on both sides, which acquire loads do not order; a read-modify-write does.
+template <typename T>
+static inline T *loadOrdered(QAtomicPointer<T> &pointer)
+{
+    return pointer.fetchAndAddOrdered(0);
+}
+
+static inline int loadOrdered(QAtomicInt &value)
+{
+    return value.fetchAndAddOrdered(0);
+}
 
 class QMultiProxyModelPrivate
 {
     QMultiProxyModel *const q_ptr;
     Q_DECLARE_PUBLIC(QMultiProxyModel)
     QList<QAbstractItemModel *> m_sourceModels;
+    QList<const QColumnarTableModel *> m_columnarSources;  // parallel to m_sourceModels, 0 for other models
 
 #if QT_VERSION >= 0x050000
     QHash<int, QByteArray> m_rolenames;
 #endif
 
+    /*
+     * Deduplication state. Every source row has an order label which ascends with the rows of
+     * its source and stays the same when rows are inserted or removed elsewhere, so the index
+     * refers to rows by label and is never renumbered. m_dedupKeys holds the rows of every key
+     * in precedence order; the first one is the winner exposed through the proxy. Most keys
+     * occur once, so the winner is stored inline and only further rows in a list.
+     */
+    struct DedupRow
+    {
+        DedupRow(int o = -1, qint64 l = 0) : order(o), label(l) {}
+        bool operator==(const DedupRow &other) const { return order == other.order && label == other.label; }
+        bool operator<(const DedupRow &other) const
+        {
+            return order < other.order || (order == other.order && label < other.label);
+        }
+
+        int order;                          // precedence of the source
+        qint64 label;                       // order label of the row in its source
+    };
+
+    struct DedupKey
+    {
+        DedupKey(const DedupRow &w = DedupRow()) : winner(w) {}
+        bool insert(const DedupRow &row);
+        bool removeSource(int order);
+
+        DedupRow winner;
+        QVector<DedupRow> others;           // sorted rows of lower precedence
+    };
+
+    struct DedupSource
+    {
+        DedupSource(int o = 0) : order(o) {}
+
+        int order;                          // precedence, ascends with the position of the source
+        QVector<QString> keys;              // key of every source row, null if the row has no key
+        QVector<qint64> labels;             // order label of every source row
+        QVector<qint64> visibleLabels;      // sorted labels of the rows exposed through the proxy
+    };
+
+    int m_dedupRole;
+    bool m_dedupRemovePending;
+    int m_dedupNextOrder;
+    QList<DedupSource> m_dedupSources;
+    QHash<QString, DedupKey> m_dedupKeys;
+
+    /*
+     * Aggregate state. Numeric values of every (column, role) pair that has aggregates are
+     * extracted per source; rows that do not contribute (non-numeric or hidden) hold NaN.
+     */
+    struct AggregateBlock
+    {
+        AggregateBlock() : sum(0), count(0), minimum(qInf()), maximum(-qInf()) {}
+        void compute(const double *values, int size);
+        void merge(const AggregateBlock &other);
+
+        double sum;
+        int count;
+        double minimum;
+        double maximum;
+    };
+
+    struct AggregateSource
+    {
+        QVector<double> values;
+        QVector<AggregateBlock> blocks;
+        AggregateBlock total;
+    };
+
+    struct AggregateColumn
+    {
+        AggregateColumn(int c = 0, int r = 0) : column(c), role(r), users(0) {}
+
+        int column;
+        int role;
+        int users;                      // number of aggregates using the column
+        QList<AggregateSource> sources; // parallel to m_sourceModels
+        AggregateBlock total;
+    };
+
+    struct Aggregate
+    {
+        int column;                     // position in m_aggregateColumns
+        QMultiProxyModel::AggregateType type;
+    };
+
+    QList<AggregateColumn> m_aggregateColumns;
+    QHash<int, Aggregate> m_aggregates;
+    int m_nextAggregateId;
+
+    /*
+     * Read snapshots. The GUI thread publishes an immutable snapshot once per event loop pass
+     * after structural changes, or when it reads a snapshot itself. Readers pin while they load and reference it; a replaced snapshot is deleted
+     * once no reader pins and no handle references it, so neither side ever waits.
+     * Each side stores one variable and then loads the other (publish the pointer, then read
+     * the pins; pin, then read the pointer), so every access of the pointer, the pins and the
+     * reference counts is a sequentially consistent read-modify-write, never a plain acquire
+     * load, otherwise both loads could see the old values and a snapshot in use be deleted.
+     */
+    bool m_snapshotsEnabled;
+    bool m_snapshotPending;
+    QSet<const QAbstractItemModel *> m_concurrentReadSafe;
+    mutable QAtomicPointer<QMultiProxyModelSnapshotData> m_snapshot;
+    mutable QAtomicInt m_snapshotPins;
+    QList<QMultiProxyModelSnapshotData *> m_retiredSnapshots;
+
+    QHash<const QAbstractItemModel *, QMultiProxyModelPlaceholder *> m_placeholders;
+
+    /*
+     * Interleave state. Every source row has a key that never decreases within its source;
+     * m_interleaved lists the source rows in proxy row order, sorted by (key, source position, row).
+     */
+    typedef QMultiProxyModelInterleaveRow InterleaveRow;
+
+    struct InterleaveLess
+    {
+        InterleaveLess(const QList<QVector<double> > &k) : keys(k) {}
+        bool operator()(const InterleaveRow &a, const InterleaveRow &b) const
+        {
+            const double ka = keys.at(a.source).at(a.row);
+            const double kb = keys.at(b.source).at(b.row);
+            return ka < kb || (ka == kb && (a.source < b.source || (a.source == b.source && a.row < b.row)));
+        }
+
+        const QList<QVector<double> > &keys;
+    };
+
+    struct InterleaveGreater
+    {
+        InterleaveGreater(const QList<QVector<double> > &k) : less(k) {}
+        bool operator()(const InterleaveRow &a, const InterleaveRow &b) const { return less(b, a); }
+
+        InterleaveLess less;
+    };
+
+    int m_interleaveRole;
+    QList<QVector<double> > m_interleaveKeys;   // parallel to m_sourceModels
+    QVector<InterleaveRow> m_interleaved;
+    QModelIndexList m_interleavePersistent;     // persistent proxy indexes during a layout change
+    QList<QPersistentModelIndex> m_interleavePersistentSources;
+
     QMultiProxyModelPrivate(QMultiProxyModel *qptr);
+    ~QMultiProxyModelPrivate();
     void updateRolenames();
     int offsetForModel(const QAbstractItemModel *) const;
     const QAbstractItemModel * sourceModelByProxyRow(int row) const;
+    int sourceRowByProxyRow(int row, int *source) const;
+    void updateColumnarSources();
+    int sourcePosition(const QAbstractItemModel *model) const;
+    int offsetForPosition(int source) const;
+    int visibleRowCount(int source) const;
+
+    bool isDeduplicating() const { return m_dedupRole >= 0 && !isInterleaving(); }
+    QString dedupKey(const QAbstractItemModel *model, int row) const;
+    void rebuildDedupIndex();
+    int dedupSourceByOrder(int order) const;
+    int dedupRow(int source, qint64 label) const;
+    void dedupInsertLabels(int source, int start, int count);
+    bool dedupIndexKey(int source, int row);
+    bool dedupUnindexKey(int source, int row);
+    bool dedupIsVisible(int source, int row) const;
+    void dedupShowWinner(const QString &key);
+    void dedupShow(int source, int row);
+    void dedupHide(int source, int row);
+    void dedupRowsInserted(int source, int start, int end);
+    void dedupRowsRemoved(int source, int start, int end);
+    bool dedupSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, bool keysChanged,
+                                QModelIndex *proxyTopLeft, QModelIndex *proxyBottomRight);
+    void dedupReplaceKeys(int source, const QVector<QString> &keys);
+    void dedupRebuildSource(int source);
+    void dedupInsertSource(int source);
+    void dedupRemoveSource(int source);
+
+    bool isInterleaving() const { return m_interleaveRole >= 0; }
+    double interleaveKey(const QAbstractItemModel *model, int row) const;
+    void interleaveReadKeys(int source, int first, int last, double *keys) const;
+    void interleaveMerge();
+    void rebuildInterleave();
+    void interleaveRebuildSource(int source);
+    void interleaveInsertSource(int source);
+    void interleaveRemoveSource(int source);
+    int interleavePosition(int source, int row) const;
+    QList<QPair<int, int> > interleaveProxyRanges(int source, int first, int last) const;
+    void interleaveRowsInserted(int source, int start, int end);
+    void interleaveRowsAboutToBeRemoved(int source, int start, int end);
+    void interleaveRowsRemoved(int source, int start, int end);
+    bool interleaveSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, bool keysChanged);
+    void interleaveLayoutAboutToBeChanged();
+    void interleaveLayoutChanged();
+
+    double aggregateValue(const AggregateColumn &column, int source, int row) const;
+    void aggregatesRecompute(AggregateColumn &column, int source, int firstBlock, int lastBlock = -1);
+    void aggregatesRebuildSource(AggregateColumn &column, int source);
+    void rebuildAggregates();
+    void aggregatesRebuildSource(int source);
+    void aggregatesInsertSource(int source);
+    void aggregatesRemoveSource(int source);
+    void aggregatesInsertRows(int source, int start, int end);
+    void aggregatesRemoveRows(int source, int start, int end);
+    void aggregatesMoveRows(int source, int start, int end, int dest);
+    void aggregatesUpdateRows(int source, int first, int last);
+    void aggregatesUpdateRows(int source, const QVector<int> &rows);
+#if QT_VERSION < 0x050000
+    void aggregatesDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+#else
+    void aggregatesDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+#endif
+
+    void schedulePublishSnapshot();
+    void publishSnapshot();
+    void retireSnapshot(QMultiProxyModelSnapshotData *data);
+
+    QMultiProxyModelPlaceholder *placeholderFor(const QMultiProxyModelDeferredSource *source) const;
+    QAbstractItemModel *materialize(QMultiProxyModelPlaceholder *placeholder);
 
 public /* slots */:
     void _q_rowsAboutToBeInserted(const QModelIndex &parent, int start, int end);
@@ -35,6 +371,8 @@ public /* slots */:
     void _q_modelAboutToBeReset();
     void _q_modelReset();
     void _q_headerDataChanged(Qt::Orientation orientation, int first, int last);
+    void _q_materializeRequested();
+    void _q_publishSnapshot();
 
 #if QT_VERSION < 0x050000
     void _q_layoutAboutToBeChanged();
@@ -47,73 +385,1483 @@ public /* slots */:
 #endif
 };
 
-QMultiProxyModelPrivate::QMultiProxyModelPrivate(QMultiProxyModel *qptr) : q_ptr(qptr)
+QMultiProxyModelPrivate::QMultiProxyModelPrivate(QMultiProxyModel *qptr) : q_ptr(qptr),
+    m_dedupRole(-1),
+    m_dedupRemovePending(false),
+    m_dedupNextOrder(0),
+    m_nextAggregateId(0),
+    m_snapshotsEnabled(false),
+    m_snapshotPending(false),
+    m_snapshot(0),
+    m_interleaveRole(-1)
+{
+}
+
+QMultiProxyModelPrivate::~QMultiProxyModelPrivate()
 {
+    delete loadOrdered(m_snapshot);
+    qDeleteAll(m_retiredSnapshots);
 }
 
 int QMultiProxyModelPrivate::offsetForModel(const QAbstractItemModel *sourceModel) const
 {
     int offset = 0;
-    foreach (QAbstractItemModel *model, m_sourceModels) {
-        if (sourceModel == model) {
+    for (int i = 0; i < m_sourceModels.size(); ++i) {
+        if (sourceModel == m_sourceModels.at(i)) {
             return offset;
         }
-        offset += model->rowCount();
+        offset += visibleRowCount(i);
     }
     return -1;
 }
 
 const QAbstractItemModel *QMultiProxyModelPrivate::sourceModelByProxyRow(int row) const
 {
+    if (isInterleaving() && row >= 0) {
+        return row < m_interleaved.size() ? m_sourceModels.at(m_interleaved.at(row).source) : 0;
+    }
+
     int offset = 0;
-    foreach (const QAbstractItemModel *model, m_sourceModels) {
-        if ((model->rowCount() + offset) > row) {
-            return model;
+    for (int i = 0; i < m_sourceModels.size(); ++i) {
+        const int count = visibleRowCount(i);
+        if ((count + offset) > row) {
+            return m_sourceModels.at(i);
         }
-        offset += model->rowCount();
+        offset += count;
     }
     return 0;
 }
 
 /*!
- * \todo In Qt5 we have no possibility to notify viewers about update of roleNames if the viewer has been using the proxy model.
- * May be we can resetModel, but it's overhead.
- * Anyway it's an expansion of functionality and not necessary now.
+ * Returns the source row that corresponds to the given proxy \a row and stores the position of
+ * its source model in \a source, or returns -1 if the row is out of range.
  */
-void QMultiProxyModelPrivate::updateRolenames()
+int QMultiProxyModelPrivate::sourceRowByProxyRow(int row, int *source) const
 {
-#if QT_VERSION < 0x050000
-    Q_Q(QMultiProxyModel);
-    QHash<int,QByteArray> allRoleNames = q->roleNames();
-    bool changed = false;
-#else
-    QHash<int,QByteArray> &allRoleNames = m_rolenames;
-#endif
+    if (row < 0) {
+        return -1;
+    }
 
-    foreach (QAbstractItemModel *model, m_sourceModels) {
-        const QHash<int,QByteArray> &modelRN = model->roleNames();
-        foreach (int role, modelRN.uniqueKeys()) {
-            if (!allRoleNames.contains(role) || allRoleNames.value(role) != modelRN.value(role) ) {
-#if QT_VERSION < 0x050000
-                changed = true;
-#endif
-                allRoleNames.insertMulti(role, modelRN.value(role));
+    if (isInterleaving()) {
+        if (row >= m_interleaved.size()) {
+            return -1;
+        }
+        *source = m_interleaved.at(row).source;
+        return m_interleaved.at(row).row;
+    }
+
+    int offset = 0;
+    for (int i = 0; i < m_sourceModels.size(); ++i) {
+        const int count = visibleRowCount(i);
+        if (row < offset + count) {
+            *source = i;
+            return isDeduplicating() ? dedupRow(i, m_dedupSources.at(i).visibleLabels.at(row - offset)) : row - offset;
+        }
+        offset += count;
+    }
+    return -1;
+}
+
+/*!
+ * Caches which source models are QColumnarTableModels that allow direct reads, so data() can
+ * bypass their data().
+ * \sa QColumnarTableModel::isDirectReadEnabled()
+ */
+void QMultiProxyModelPrivate::updateColumnarSources()
+{
+    m_columnarSources.clear();
+    foreach (const QAbstractItemModel *model, m_sourceModels) {
+        const QColumnarTableModel *columnar = qobject_cast<const QColumnarTableModel *>(model);
+        m_columnarSources.append(columnar && columnar->isDirectReadEnabled() ? columnar : 0);
+    }
+}
+
+int QMultiProxyModelPrivate::sourcePosition(const QAbstractItemModel *model) const
+{
+    for (int i = 0; i < m_sourceModels.size(); ++i) {
+        if (m_sourceModels.at(i) == model) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int QMultiProxyModelPrivate::offsetForPosition(int source) const
+{
+    int offset = 0;
+    for (int i = 0; i < source; ++i) {
+        offset += visibleRowCount(i);
+    }
+    return offset;
+}
+
+/*!
+ * Returns the number of proxy rows provided by the source model at position \a source.
+ */
+int QMultiProxyModelPrivate::visibleRowCount(int source) const
+{
+    if (isDeduplicating()) {
+        return m_dedupSources.at(source).visibleLabels.size();
+    }
+    return m_sourceModels.at(source)->rowCount();
+}
+
+/*!
+ * Returns the deduplication key of the given source row, or a null string if the row has no key.
+ * Rows without a key are never collapsed.
+ */
+QString QMultiProxyModelPrivate::dedupKey(const QAbstractItemModel *model, int row) const
+{
+    const QVariant value = model->data(model->index(row, 0), m_dedupRole);
+    return value.isValid() ? value.toString() : QString();
+}
+
+void QMultiProxyModelPrivate::rebuildDedupIndex()
+{
+    m_dedupKeys.clear();
+    m_dedupSources.clear();
+    m_dedupRemovePending = false;
+    m_dedupNextOrder = 0;
+    if (!isDeduplicating()) {
+        return;
+    }
+
+    for (int i = 0; i < m_sourceModels.size(); ++i) {
+        const QAbstractItemModel *model = m_sourceModels.at(i);
+        const int rows = model->rowCount();
+        const bool placeholder = m_placeholders.contains(model);
+        DedupSource entry(m_dedupNextOrder++);
+        entry.keys.reserve(rows);
+        entry.labels.reserve(rows);
+        for (int row = 0; row < rows; ++row) {
+            // Reading the placeholder would materialize it, its rows are just never collapsed.
+            const QString key = placeholder ? QString() : dedupKey(model, row);
+            const qint64 label = (row + 1) * DedupLabelSpacing;
+            entry.keys.append(key);
+            entry.labels.append(label);
+            if (key.isNull()) {
+                entry.visibleLabels.append(label);
+                continue;
+            }
+            // Sources and rows are visited in precedence order, so appending keeps the rows sorted.
+            QHash<QString, DedupKey>::iterator it = m_dedupKeys.find(key);
+            if (it == m_dedupKeys.end()) {
+                m_dedupKeys.insert(key, DedupKey(DedupRow(entry.order, label)));
+                entry.visibleLabels.append(label);
+            } else {
+                it.value().others.append(DedupRow(entry.order, label));
             }
         }
+        m_dedupSources.append(entry);
     }
-#if QT_VERSION < 0x050000
-    if (changed) {
-        q->setRoleNames(allRoleNames);
+}
+
+/*!
+ * Returns the position of the source with the given precedence \a order.
+ */
+int QMultiProxyModelPrivate::dedupSourceByOrder(int order) const
+{
+    int low = 0;
+    int high = m_dedupSources.size();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (m_dedupSources.at(middle).order < order) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
     }
-#endif
+    return low;
 }
 
-void QMultiProxyModelPrivate::_q_rowsAboutToBeInserted(const QModelIndex &parent, int start, int end)
+/*!
+ * Returns the row of the source at position \a source that has the given order \a label.
+ */
+int QMultiProxyModelPrivate::dedupRow(int source, qint64 label) const
+{
+    const QVector<qint64> &labels = m_dedupSources.at(source).labels;
+    return std::lower_bound(labels.constBegin(), labels.constEnd(), label) - labels.constBegin();
+}
+
+/*!
+ * Returns \a label changed to the label at the same position in \a to if it's one of \a from.
+ */
+static inline qint64 dedupRelabeled(const QVector<qint64> &from, const QVector<qint64> &to, qint64 label)
+{
+    const int i = std::lower_bound(from.constBegin(), from.constEnd(), label) - from.constBegin();
+    return i < from.size() && from.at(i) == label ? to.at(i) : label;
+}
+
+/*!
+ * Inserts the labels of \a count rows inserted at \a start into the source at position \a source;
+ * the keys must be inserted already. The new rows take labels between their neighbours. If there
+ * is no room, a range around them is relabeled evenly, which doubles until its gaps are wide enough,
+ * so rows are relabeled rarely and appended rows never are.
+ */
+void QMultiProxyModelPrivate::dedupInsertLabels(int source, int start, int count)
+{
+    DedupSource &entry = m_dedupSources[source];
+    QVector<qint64> &labels = entry.labels;
+    labels.insert(start, count, 0);
+    const int size = labels.size();
+
+    int first = start;
+    int last = start + count;
+    qint64 lower = 0;
+    qint64 gap = 0;
+    for (int width = 0; ; width = qMax(1, 2 * width)) {
+        first = qMax(0, start - width);
+        last = qMin(size, start + count + width);
+        lower = first > 0 ? labels.at(first - 1) : 0;
+        if (last == size) {
+            gap = DedupLabelSpacing;
+            break;
+        }
+        gap = (labels.at(last) - lower) / (last - first + 1);
+        if (gap >= (width == 0 ? 1 : DedupMinimumLabelGap)) {
+            break;
+        }
+    }
+
+    QVector<qint64> from;
+    QVector<qint64> to;
+    for (int row = first; row < last; ++row) {
+        const qint64 label = lower + gap * (row - first + 1);
+        if (row < start || row >= start + count) {
+            from.append(labels.at(row));
+            to.append(label);
+        }
+        labels[row] = label;
+    }
+    if (from.isEmpty()) {
+        return;
+    }
+
+    // The relabeled rows keep their order, so the visible labels and the rows of every key stay sorted.
+    QVector<qint64> &visible = entry.visibleLabels;
+    const int firstVisible = std::lower_bound(visible.constBegin(), visible.constEnd(), from.first()) - visible.constBegin();
+    const int lastVisible = std::upper_bound(visible.constBegin(), visible.constEnd(), from.last()) - visible.constBegin();
+    for (int i = firstVisible; i < lastVisible; ++i) {
+        visible[i] = dedupRelabeled(from, to, visible.at(i));
+    }
+
+    QSet<QString> relabeledKeys;
+    for (int row = first; row < last; ++row) {
+        const QString &key = entry.keys.at(row);
+        if (key.isNull() || (row >= start && row < start + count) || relabeledKeys.contains(key)) {
+            continue;
+        }
+        relabeledKeys.insert(key);
+        DedupKey &rows = m_dedupKeys[key];
+        if (rows.winner.order == entry.order) {
+            rows.winner.label = dedupRelabeled(from, to, rows.winner.label);
+        }
+        for (int i = 0; i < rows.others.size(); ++i) {
+            if (rows.others.at(i).order == entry.order) {
+                rows.others[i].label = dedupRelabeled(from, to, rows.others.at(i).label);
+            }
+        }
+    }
+}
+
+/*!
+ * Inserts \a row in precedence order.
+ * \return Returns true if the row became the winner; the former one is then the first of the others.
+ */
+bool QMultiProxyModelPrivate::DedupKey::insert(const DedupRow &row)
+{
+    if (winner < row) {
+        others.insert(std::lower_bound(others.constBegin(), others.constEnd(), row) - others.constBegin(), row);
+        return false;
+    }
+    others.prepend(winner);
+    winner = row;
+    return true;
+}
+
+/*!
+ * Drops the rows of the source with the given precedence \a order, which are adjacent.
+ * \return Returns true if no row is left.
+ */
+bool QMultiProxyModelPrivate::DedupKey::removeSource(int order)
+{
+    // Labels are positive, so the rows of the source lie between these bounds.
+    const int first = std::lower_bound(others.constBegin(), others.constEnd(), DedupRow(order, 0)) - others.constBegin();
+    const int last = std::lower_bound(others.constBegin(), others.constEnd(), DedupRow(order + 1, 0)) - others.constBegin();
+    others.remove(first, last - first);
+    if (winner.order != order) {
+        return false;
+    }
+    if (others.isEmpty()) {
+        return true;
+    }
+    winner = others.first();
+    others.remove(0);
+    return false;
+}
+
+/*!
+ * Puts the key of the given row into the index.
+ * If the row takes precedence over the current winner of its key, the former winner is hidden.
+ * \return Returns true if the row is the winner for its key and has to be shown.
+ */
+bool QMultiProxyModelPrivate::dedupIndexKey(int source, int row)
+{
+    const DedupSource &entry = m_dedupSources.at(source);
+    const QString key = entry.keys.at(row);
+    if (key.isNull()) {
+        return true;
+    }
+
+    const DedupRow added(entry.order, entry.labels.at(row));
+    QHash<QString, DedupKey>::iterator it = m_dedupKeys.find(key);
+    if (it == m_dedupKeys.end()) {
+        m_dedupKeys.insert(key, DedupKey(added));
+        return true;
+    }
+
+    const DedupRow former = it.value().winner;
+    if (!it.value().insert(added)) {
+        return false;
+    }
+    const int formerSource = dedupSourceByOrder(former.order);
+    dedupHide(formerSource, dedupRow(formerSource, former.label));
+    return true;
+}
+
+/*!
+ * Takes the key of the given row out of the index. Nothing is shown or hidden.
+ * \return Returns true if the row was the winner for its key and another row has to take its place.
+ */
+bool QMultiProxyModelPrivate::dedupUnindexKey(int source, int row)
+{
+    const DedupSource &entry = m_dedupSources.at(source);
+    const QString key = entry.keys.at(row);
+    if (key.isNull()) {
+        return false;
+    }
+
+    const DedupRow removed(entry.order, entry.labels.at(row));
+    QHash<QString, DedupKey>::iterator it = m_dedupKeys.find(key);
+    Q_ASSERT(it != m_dedupKeys.end());
+    DedupKey &rows = it.value();
+    if (!(rows.winner == removed)) {
+        const int pos = std::lower_bound(rows.others.constBegin(), rows.others.constEnd(), removed) - rows.others.constBegin();
+        Q_ASSERT(pos < rows.others.size() && rows.others.at(pos) == removed);
+        rows.others.remove(pos);
+        return false;
+    }
+    if (rows.others.isEmpty()) {
+        m_dedupKeys.erase(it);
+        return false;
+    }
+    rows.winner = rows.others.first();
+    rows.others.remove(0);
+    return true;
+}
+
+bool QMultiProxyModelPrivate::dedupIsVisible(int source, int row) const
+{
+    const DedupSource &entry = m_dedupSources.at(source);
+    return std::binary_search(entry.visibleLabels.constBegin(), entry.visibleLabels.constEnd(), entry.labels.at(row));
+}
+
+void QMultiProxyModelPrivate::dedupShowWinner(const QString &key)
+{
+    QHash<QString, DedupKey>::const_iterator it = m_dedupKeys.constFind(key);
+    if (it != m_dedupKeys.constEnd()) {
+        const int source = dedupSourceByOrder(it.value().winner.order);
+        dedupShow(source, dedupRow(source, it.value().winner.label));
+    }
+}
+
+void QMultiProxyModelPrivate::dedupShow(int source, int row)
 {
     Q_Q(QMultiProxyModel);
-    QAbstractItemModel *srcModel = qobject_cast<QAbstractItemModel*>(q->sender());
-    Q_ASSERT(srcModel);
-    Q_ASSERT(parent.isValid() ? parent.model() == srcModel : true);
+    DedupSource &entry = m_dedupSources[source];
+    const qint64 label = entry.labels.at(row);
+    QVector<qint64> &visible = entry.visibleLabels;
+    const int pos = std::lower_bound(visible.constBegin(), visible.constEnd(), label) - visible.constBegin();
+    const int proxyRow = offsetForPosition(source) + pos;
+
+    q->beginInsertRows(QModelIndex(), proxyRow, proxyRow);
+    visible.insert(pos, label);
+    aggregatesUpdateRows(source, row, row);
+    q->endInsertRows();
+}
+
+void QMultiProxyModelPrivate::dedupHide(int source, int row)
+{
+    Q_Q(QMultiProxyModel);
+    DedupSource &entry = m_dedupSources[source];
+    const qint64 label = entry.labels.at(row);
+    QVector<qint64> &visible = entry.visibleLabels;
+    const int pos = std::lower_bound(visible.constBegin(), visible.constEnd(), label) - visible.constBegin();
+    Q_ASSERT(pos < visible.size() && visible.at(pos) == label);
+    const int proxyRow = offsetForPosition(source) + pos;
+
+    q->beginRemoveRows(QModelIndex(), proxyRow, proxyRow);
+    visible.remove(pos);
+    aggregatesUpdateRows(source, row, row);
+    q->endRemoveRows();
+}
+
+/*!
+ * Indexes the rows inserted into the source at position \a source.
+ * Winning new rows are contiguous in the proxy and are announced at once;
+ * rows of lower precedence which they replace are removed one by one.
+ */
+void QMultiProxyModelPrivate::dedupRowsInserted(int source, int start, int end)
+{
+    Q_Q(QMultiProxyModel);
+    const QAbstractItemModel *model = m_sourceModels.at(source);
+    const int count = end - start + 1;
+
+    DedupSource &entry = m_dedupSources[source];
+    entry.keys.insert(start, count, QString());
+    dedupInsertLabels(source, start, count);
+
+    QVector<qint64> shown;
+    for (int row = start; row <= end; ++row) {
+        entry.keys[row] = dedupKey(model, row);
+        if (dedupIndexKey(source, row)) {
+            shown.append(entry.labels.at(row));
+        }
+    }
+    if (shown.isEmpty()) {
+        return;
+    }
+
+    QVector<qint64> &visible = entry.visibleLabels;
+    const int pos = std::lower_bound(visible.constBegin(), visible.constEnd(), shown.first()) - visible.constBegin();
+    const int proxyStart = offsetForPosition(source) + pos;
+
+    q->beginInsertRows(QModelIndex(), proxyStart, proxyStart + shown.size() - 1);
+    visible.insert(pos, shown.size(), 0);
+    std::copy(shown.constBegin(), shown.constEnd(), visible.begin() + pos);
+    aggregatesUpdateRows(source, start, end);
+    q->endInsertRows();
+}
+
+/*!
+ * Drops the rows removed from the source at position \a source from the index.
+ * The visible ones have been announced by _q_rowsAboutToBeRemoved(); rows of lower
+ * precedence which take their places are shown afterwards.
+ */
+void QMultiProxyModelPrivate::dedupRowsRemoved(int source, int start, int end)
+{
+    Q_Q(QMultiProxyModel);
+    const int count = end - start + 1;
+    DedupSource &entry = m_dedupSources[source];
+
+    QSet<QString> orphanedKeys;
+    for (int row = start; row <= end; ++row) {
+        if (dedupUnindexKey(source, row)) {
+            orphanedKeys.insert(entry.keys.at(row));
+        }
+    }
+
+    QVector<qint64> &visible = entry.visibleLabels;
+    const int first = std::lower_bound(visible.constBegin(), visible.constEnd(), entry.labels.at(start)) - visible.constBegin();
+    const int last = std::upper_bound(visible.constBegin(), visible.constEnd(), entry.labels.at(end)) - visible.constBegin();
+    visible.remove(first, last - first);
+    entry.keys.remove(start, count);
+    entry.labels.remove(start, count);
+
+    if (m_dedupRemovePending) {
+        m_dedupRemovePending = false;
+        q->endRemoveRows();
+    }
+
+    foreach (const QString &key, orphanedKeys) {
+        dedupShowWinner(key);
+    }
+}
+
+/*!
+ * Re-indexes the changed source rows whose keys differ from the indexed ones and
+ * returns the proxy range of the changed rows that stay visible.
+ * \a proxyTopLeft is left invalid if none of them is visible.
+ * \return Returns true if any key changed.
+ */
+bool QMultiProxyModelPrivate::dedupSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, bool keysChanged,
+                                                     QModelIndex *proxyTopLeft, QModelIndex *proxyBottomRight)
+{
+    Q_Q(QMultiProxyModel);
+    const int source = sourcePosition(topLeft.model());
+    if (source < 0) {
+        return false;
+    }
+
+    const QAbstractItemModel *model = m_sourceModels.at(source);
+    const int top = topLeft.row();
+    const int bottom = bottomRight.row();
+    bool changed = false;
+    if (keysChanged && topLeft.column() == 0) {
+        for (int row = top; row <= bottom; ++row) {
+            const QString key = dedupKey(model, row);
+            const QString oldKey = m_dedupSources.at(source).keys.at(row);
+            if (key == oldKey && key.isNull() == oldKey.isNull()) {
+                continue;
+            }
+            changed = true;
+
+            const bool wasVisible = dedupIsVisible(source, row);
+            const bool orphaned = dedupUnindexKey(source, row);
+            m_dedupSources[source].keys[row] = key;
+            const bool wins = dedupIndexKey(source, row);
+            if (wasVisible && !wins) {
+                dedupHide(source, row);
+            } else if (!wasVisible && wins) {
+                dedupShow(source, row);
+            }
+            if (orphaned) {
+                dedupShowWinner(oldKey);
+            }
+        }
+    }
+
+    const DedupSource &entry = m_dedupSources.at(source);
+    const QVector<qint64> &visible = entry.visibleLabels;
+    const int first = std::lower_bound(visible.constBegin(), visible.constEnd(), entry.labels.at(top)) - visible.constBegin();
+    const int last = std::upper_bound(visible.constBegin(), visible.constEnd(), entry.labels.at(bottom)) - visible.constBegin();
+    if (first < last) {
+        const int offset = offsetForPosition(source);
+        *proxyTopLeft = q->index(offset + first, topLeft.column());
+        *proxyBottomRight = q->index(offset + last - 1, bottomRight.column());
+    }
+    return changed;
+}
+
+/*!
+ * Replaces the indexed keys of the source at position \a source with \a keys, one for every current
+ * row of the source, which are labeled afresh. Rows of other sources whose keys the source gains or
+ * loses are hidden or shown without notification, so the proxy model must be in a reset. Only the
+ * changed rows of the other sources are read for the aggregates; the ones of the source are left to the caller.
+ */
+void QMultiProxyModelPrivate::dedupReplaceKeys(int source, const QVector<QString> &keys)
+{
+    DedupSource &entry = m_dedupSources[source];
+
+    // The winners of all keys the source had or gets, before the change.
+    QHash<QString, DedupRow> formerWinners;
+    for (int i = 0; i < entry.keys.size() + keys.size(); ++i) {
+        const QString &key = i < entry.keys.size() ? entry.keys.at(i) : keys.at(i - entry.keys.size());
+        if (!key.isNull() && !formerWinners.contains(key)) {
+            formerWinners.insert(key, m_dedupKeys.value(key).winner);
+        }
+    }
+
+    foreach (const QString &key, entry.keys) {
+        QHash<QString, DedupKey>::iterator it = m_dedupKeys.find(key);
+        if (it != m_dedupKeys.end() && it.value().removeSource(entry.order)) {
+            m_dedupKeys.erase(it);
+        }
+    }
+
+    const int rows = keys.size();
+    entry.keys = keys;
+    entry.labels.resize(rows);
+    entry.visibleLabels.clear();
+    for (int row = 0; row < rows; ++row) {
+        entry.labels[row] = (row + 1) * DedupLabelSpacing;
+        const QString &key = keys.at(row);
+        if (key.isNull()) {
+            continue;
+        }
+        const DedupRow added(entry.order, entry.labels.at(row));
+        QHash<QString, DedupKey>::iterator it = m_dedupKeys.find(key);
+        if (it == m_dedupKeys.end()) {
+            m_dedupKeys.insert(key, DedupKey(added));
+        } else {
+            it.value().insert(added);
+        }
+    }
+    for (int row = 0; row < rows; ++row) {
+        const QString &key = keys.at(row);
+        const qint64 label = entry.labels.at(row);
+        if (key.isNull() || m_dedupKeys.value(key).winner == DedupRow(entry.order, label)) {
+            entry.visibleLabels.append(label);
+        }
+    }
+
+    // Winners of other sources which changed are hidden or shown there.
+    QHash<int, QVector<int> > changedRows;
+    QHash<QString, DedupRow>::const_iterator it = formerWinners.constBegin();
+    for ( ; it != formerWinners.constEnd(); ++it) {
+        const DedupRow former = it.value();
+        const DedupRow winner = m_dedupKeys.value(it.key()).winner;
+        if (former == winner) {
+            continue;
+        }
+        if (former.order >= 0 && former.order != entry.order) {
+            const int other = dedupSourceByOrder(former.order);
+            QVector<qint64> &visible = m_dedupSources[other].visibleLabels;
+            visible.remove(std::lower_bound(visible.constBegin(), visible.constEnd(), former.label) - visible.constBegin());
+            changedRows[other].append(dedupRow(other, former.label));
+        }
+        if (winner.order >= 0 && winner.order != entry.order) {
+            const int other = dedupSourceByOrder(winner.order);
+            QVector<qint64> &visible = m_dedupSources[other].visibleLabels;
+            visible.insert(std::lower_bound(visible.constBegin(), visible.constEnd(), winner.label) - visible.constBegin(), winner.label);
+            changedRows[other].append(dedupRow(other, winner.label));
+        }
+    }
+
+    QHash<int, QVector<int> >::iterator changed = changedRows.begin();
+    for ( ; changed != changedRows.end(); ++changed) {
+        QVector<int> &rows = changed.value();
+        std::sort(rows.begin(), rows.end());
+        aggregatesUpdateRows(changed.key(), rows);
+    }
+}
+
+/*!
+ * Reads the keys of the source at position \a source again; the other sources are not read.
+ * \sa dedupReplaceKeys()
+ */
+void QMultiProxyModelPrivate::dedupRebuildSource(int source)
+{
+    if (!isDeduplicating()) {
+        return;
+    }
+
+    const QAbstractItemModel *model = m_sourceModels.at(source);
+    const int rows = model->rowCount();
+    // Reading the placeholder would materialize it, its rows are just never collapsed.
+    QVector<QString> keys(rows);
+    if (!m_placeholders.contains(model)) {
+        for (int row = 0; row < rows; ++row) {
+            keys[row] = dedupKey(model, row);
+        }
+    }
+    dedupReplaceKeys(source, keys);
+}
+
+/*!
+ * Indexes the source model appended at position \a source, which has the lowest precedence.
+ */
+void QMultiProxyModelPrivate::dedupInsertSource(int source)
+{
+    if (!isDeduplicating()) {
+        return;
+    }
+
+    Q_ASSERT(source == m_dedupSources.size());
+    m_dedupSources.append(DedupSource(m_dedupNextOrder++));
+    dedupRebuildSource(source);
+}
+
+/*!
+ * Drops the source model at position \a source from the index.
+ * Rows of the other sources which it hid become visible.
+ */
+void QMultiProxyModelPrivate::dedupRemoveSource(int source)
+{
+    if (!isDeduplicating()) {
+        return;
+    }
+
+    dedupReplaceKeys(source, QVector<QString>());
+    m_dedupSources.removeAt(source);
+}
+
+/*!
+ * Returns the interleave key of the given source row, or NaN if the row has no key.
+ * Dates are ordered by their milliseconds since the epoch.
+ */
+double QMultiProxyModelPrivate::interleaveKey(const QAbstractItemModel *model, int row) const
+{
+    const QVariant value = model->data(model->index(row, 0), m_interleaveRole);
+    if (value.type() == QVariant::DateTime || value.type() == QVariant::Date) {
+        return double(value.toDateTime().toMSecsSinceEpoch());
+    }
+    bool ok = false;
+    const double key = value.toDouble(&ok);
+    return ok ? key : qQNaN();
+}
+
+/*!
+ * Reads the keys of the source rows from \a first to \a last into \a keys. Every key is bounded by
+ * the stored keys of the surrounding rows, so a row without a key or out of order stays next to
+ * its predecessor.
+ */
+void QMultiProxyModelPrivate::interleaveReadKeys(int source, int first, int last, double *keys) const
+{
+    const QVector<double> &stored = m_interleaveKeys.at(source);
+    const QAbstractItemModel *model = m_sourceModels.at(source);
+    const bool placeholder = m_placeholders.contains(model);
+    const double next = last + 1 < stored.size() ? stored.at(last + 1) : qInf();
+    double previous = first > 0 ? stored.at(first - 1) : -qInf();
+    for (int row = first; row <= last; ++row) {
+        // Reading the placeholder would materialize it, its rows follow all the others.
+        const double key = placeholder ? qInf() : interleaveKey(model, row);
+        if (!qIsNaN(key)) {
+            previous = qBound(previous, key, next);
+        }
+        keys[row - first] = previous;
+    }
+}
+
+/*!
+ * Merges the ordered source rows into m_interleaved. A heap holds the next row of every source,
+ * so n rows of k sources are merged in O(n log k).
+ */
+void QMultiProxyModelPrivate::interleaveMerge()
+{
+    m_interleaved.clear();
+    QVector<InterleaveRow> heap;
+    int rows = 0;
+    for (int i = 0; i < m_interleaveKeys.size(); ++i) {
+        if (!m_interleaveKeys.at(i).isEmpty()) {
+            heap.append(InterleaveRow(i, 0));
+            rows += m_interleaveKeys.at(i).size();
+        }
+    }
+
+    const InterleaveGreater greater(m_interleaveKeys);
+    std::make_heap(heap.begin(), heap.end(), greater);
+    m_interleaved.reserve(rows);
+    while (!heap.isEmpty()) {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        InterleaveRow &next = heap.last();
+        m_interleaved.append(next);
+        if (++next.row < m_interleaveKeys.at(next.source).size()) {
+            std::push_heap(heap.begin(), heap.end(), greater);
+        } else {
+            heap.resize(heap.size() - 1);
+        }
+    }
+}
+
+void QMultiProxyModelPrivate::rebuildInterleave()
+{
+    m_interleaveKeys.clear();
+    m_interleaved.clear();
+    if (!isInterleaving()) {
+        return;
+    }
+
+    for (int i = 0; i < m_sourceModels.size(); ++i) {
+        const int rows = m_sourceModels.at(i)->rowCount();
+        m_interleaveKeys.append(QVector<double>(rows));
+        interleaveReadKeys(i, 0, rows - 1, m_interleaveKeys[i].data());
+    }
+    interleaveMerge();
+}
+
+/*!
+ * Reads the keys of the source at position \a source again and merges the rows anew;
+ * the other sources are not read.
+ */
+void QMultiProxyModelPrivate::interleaveRebuildSource(int source)
+{
+    if (!isInterleaving()) {
+        return;
+    }
+
+    const int rows = m_sourceModels.at(source)->rowCount();
+    m_interleaveKeys[source] = QVector<double>(rows);
+    interleaveReadKeys(source, 0, rows - 1, m_interleaveKeys[source].data());
+    interleaveMerge();
+}
+
+void QMultiProxyModelPrivate::interleaveInsertSource(int source)
+{
+    if (!isInterleaving()) {
+        return;
+    }
+
+    m_interleaveKeys.insert(source, QVector<double>());
+    interleaveRebuildSource(source);
+}
+
+void QMultiProxyModelPrivate::interleaveRemoveSource(int source)
+{
+    if (!isInterleaving()) {
+        return;
+    }
+
+    m_interleaveKeys.removeAt(source);
+    interleaveMerge();
+}
+
+/*!
+ * Returns the proxy row of the given source row, or -1 if the row is not interleaved.
+ */
+int QMultiProxyModelPrivate::interleavePosition(int source, int row) const
+{
+    if (row < 0 || row >= m_interleaveKeys.at(source).size()) {
+        return -1;
+    }
+
+    const InterleaveRow entry(source, row);
+    QVector<InterleaveRow>::const_iterator it = std::lower_bound(m_interleaved.constBegin(), m_interleaved.constEnd(),
+                                                                 entry, InterleaveLess(m_interleaveKeys));
+    if (it == m_interleaved.constEnd() || it->source != source || it->row != row) {
+        return -1;
+    }
+    return it - m_interleaved.constBegin();
+}
+
+/*!
+ * Returns the contiguous proxy row ranges of the source rows from \a first to \a last in ascending order.
+ */
+QList<QPair<int, int> > QMultiProxyModelPrivate::interleaveProxyRanges(int source, int first, int last) const
+{
+    // The rows of a source are ordered, so their proxy rows ascend.
+    QList<QPair<int, int> > ranges;
+    for (int row = first; row <= last; ++row) {
+        const int position = interleavePosition(source, row);
+        if (position < 0) {
+            continue;
+        }
+        if (!ranges.isEmpty() && ranges.last().second + 1 == position) {
+            ranges.last().second = position;
+        } else {
+            ranges.append(qMakePair(position, position));
+        }
+    }
+    return ranges;
+}
+
+/*!
+ * Interleaves the rows inserted into the source at position \a source. The new rows are placed
+ * by binary search; rows that share a proxy position are inserted as one block, so rows appended
+ * after the last proxy row cost a single insertion and leave the rest of the mapping untouched.
+ */
+void QMultiProxyModelPrivate::interleaveRowsInserted(int source, int start, int end)
+{
+    Q_Q(QMultiProxyModel);
+    const int count = end - start + 1;
+    QVector<double> &keys = m_interleaveKeys[source];
+    if (start < keys.size()) {
+        for (int i = 0; i < m_interleaved.size(); ++i) {
+            InterleaveRow &entry = m_interleaved[i];
+            if (entry.source == source && entry.row >= start) {
+                entry.row += count;
+            }
+        }
+    }
+    keys.insert(start, count, 0.0);
+    interleaveReadKeys(source, start, end, keys.data() + start);
+
+    // The positions refer to the mapping without the new rows.
+    const InterleaveLess less(m_interleaveKeys);
+    QVector<int> positions(count, m_interleaved.size());
+    if (!m_interleaved.isEmpty() && less(InterleaveRow(source, start), m_interleaved.last())) {
+        for (int row = start; row <= end; ++row) {
+            positions[row - start] = std::upper_bound(m_interleaved.constBegin(), m_interleaved.constEnd(),
+                                                      InterleaveRow(source, row), less) - m_interleaved.constBegin();
+        }
+    }
+
+    int inserted = 0;
+    for (int first = 0; first < count; ) {
+        int last = first;
+        while (last + 1 < count && positions.at(last + 1) == positions.at(first)) {
+            ++last;
+        }
+        const int proxyRow = positions.at(first) + inserted;
+        q->beginInsertRows(QModelIndex(), proxyRow, proxyRow + last - first);
+        m_interleaved.insert(proxyRow, last - first + 1, InterleaveRow());
+        for (int i = first; i <= last; ++i) {
+            m_interleaved[proxyRow + i - first] = InterleaveRow(source, start + i);
+        }
+        q->endInsertRows();
+        inserted += last - first + 1;
+        first = last + 1;
+    }
+}
+
+/*!
+ * Removes the proxy rows of the source rows that are about to be removed, range by range from the last one.
+ */
+void QMultiProxyModelPrivate::interleaveRowsAboutToBeRemoved(int source, int start, int end)
+{
+    Q_Q(QMultiProxyModel);
+    const QList<QPair<int, int> > ranges = interleaveProxyRanges(source, start, end);
+    for (int i = ranges.size() - 1; i >= 0; --i) {
+        const QPair<int, int> &range = ranges.at(i);
+        q->beginRemoveRows(QModelIndex(), range.first, range.second);
+        m_interleaved.remove(range.first, range.second - range.first + 1);
+        q->endRemoveRows();
+    }
+}
+
+void QMultiProxyModelPrivate::interleaveRowsRemoved(int source, int start, int end)
+{
+    const int count = end - start + 1;
+    QVector<double> &keys = m_interleaveKeys[source];
+    if (end + 1 < keys.size()) {
+        for (int i = 0; i < m_interleaved.size(); ++i) {
+            InterleaveRow &entry = m_interleaved[i];
+            if (entry.source == source && entry.row > end) {
+                entry.row -= count;
+            }
+        }
+    }
+    keys.remove(start, count);
+}
+
+/*!
+ * Re-reads the keys of the changed source rows. If any of them differs, the rows are merged
+ * again and the persistent indexes are moved along.
+ * \return Returns true if any key changed.
+ */
+bool QMultiProxyModelPrivate::interleaveSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, bool keysChanged)
+{
+    const int source = sourcePosition(topLeft.model());
+    if (source < 0 || !keysChanged || topLeft.column() != 0) {
+        return false;
+    }
+
+    const int top = topLeft.row();
+    const int bottom = bottomRight.row();
+    QVector<double> keys(bottom - top + 1);
+    interleaveReadKeys(source, top, bottom, keys.data());
+    if (std::equal(keys.constBegin(), keys.constEnd(), m_interleaveKeys.at(source).constBegin() + top)) {
+        return false;
+    }
+
+    // Views map the persistent indexes while handling layoutAboutToBeChanged(), which needs
+    // the stored keys to match the merged order; the new keys are stored only afterwards.
+    interleaveLayoutAboutToBeChanged();
+    std::copy(keys.constBegin(), keys.constEnd(), m_interleaveKeys[source].begin() + top);
+    interleaveMerge();
+    interleaveLayoutChanged();
+    return true;
+}
+
+/*!
+ * Emits layoutAboutToBeChanged() and remembers the source indexes of the persistent proxy indexes.
+ */
+void QMultiProxyModelPrivate::interleaveLayoutAboutToBeChanged()
+{
+    Q_Q(QMultiProxyModel);
+    emit q->layoutAboutToBeChanged();
+    m_interleavePersistent = q->persistentIndexList();
+    m_interleavePersistentSources.clear();
+    foreach (const QModelIndex &index, m_interleavePersistent) {
+        m_interleavePersistentSources.append(QPersistentModelIndex(q->mapToSource(index)));
+    }
+}
+
+/*!
+ * Moves the persistent proxy indexes to the new proxy rows of their source indexes and emits layoutChanged().
+ */
+void QMultiProxyModelPrivate::interleaveLayoutChanged()
+{
+    Q_Q(QMultiProxyModel);
+    QModelIndexList indexes;
+    foreach (const QPersistentModelIndex &index, m_interleavePersistentSources) {
+        indexes.append(q->mapFromSource(index));
+    }
+    q->changePersistentIndexList(m_interleavePersistent, indexes);
+    m_interleavePersistent.clear();
+    m_interleavePersistentSources.clear();
+    emit q->layoutChanged();
+}
+
+void QMultiProxyModelPrivate::AggregateBlock::compute(const double *values, int size)
+{
+    // Lane l accumulates the values i with i % AggregateLanes == l, so the inner loop has no
+    // dependency between its iterations. With the flags of qmultiproxymodel.pro and the default
+    // -O2, GCC turns it into packed additions, minimums and maximums; the result doesn't depend on that.
+    // NaN values fail every comparison and are skipped.
+    double s[AggregateLanes];
+    double n[AggregateLanes];
+    double lo[AggregateLanes];
+    double hi[AggregateLanes];
+    for (int l = 0; l < AggregateLanes; ++l) {
+        s[l] = 0;
+        n[l] = 0;
+        lo[l] = qInf();
+        hi[l] = -qInf();
+    }
+
+    const int body = size - size % AggregateLanes;
+    for (int i = 0; i < body; i += AggregateLanes) {
+        for (int l = 0; l < AggregateLanes; ++l) {
+            const double value = values[i + l];
+            const bool valid = value == value;
+            s[l] += valid ? value : 0.0;
+            n[l] += valid ? 1.0 : 0.0;
+            lo[l] = value < lo[l] ? value : lo[l];
+            hi[l] = value > hi[l] ? value : hi[l];
+        }
+    }
+    for (int i = body; i < size; ++i) {
+        const double value = values[i];
+        const bool valid = value == value;
+        s[0] += valid ? value : 0.0;
+        n[0] += valid ? 1.0 : 0.0;
+        lo[0] = value < lo[0] ? value : lo[0];
+        hi[0] = value > hi[0] ? value : hi[0];
+    }
+
+    double total = 0;
+    sum = 0;
+    minimum = lo[0];
+    maximum = hi[0];
+    for (int l = 0; l < AggregateLanes; ++l) {
+        sum += s[l];
+        total += n[l];
+        minimum = qMin(minimum, lo[l]);
+        maximum = qMax(maximum, hi[l]);
+    }
+    count = int(total);
+}
+
+void QMultiProxyModelPrivate::AggregateBlock::merge(const AggregateBlock &other)
+{
+    sum += other.sum;
+    count += other.count;
+    minimum = qMin(minimum, other.minimum);
+    maximum = qMax(maximum, other.maximum);
+}
+
+/*!
+ * Returns the numeric value the given source row contributes to the aggregates of \a column,
+ * or NaN if the row does not contribute.
+ */
+double QMultiProxyModelPrivate::aggregateValue(const AggregateColumn &column, int source, int row) const
+{
+    if (isDeduplicating() && !dedupIsVisible(source, row)) {
+        return qQNaN();
+    }
+
+    const QColumnarTableModel *columnar = m_columnarSources.at(source);
+    const QAbstractItemModel *model = m_sourceModels.at(source);
+    const QVariant value = columnar && (column.role == Qt::DisplayRole || column.role == Qt::EditRole)
+            ? columnar->value(row, column.column)
+            : model->data(model->index(row, column.column), column.role);
+    bool ok = false;
+    const double number = value.toDouble(&ok);
+    return ok ? number : qQNaN();
+}
+
+/*!
+ * Recomputes the blocks of the source at position \a source from \a firstBlock to \a lastBlock
+ * (to the end if \a lastBlock is negative), then the totals of the source and of the column.
+ */
+void QMultiProxyModelPrivate::aggregatesRecompute(AggregateColumn &column, int source, int firstBlock, int lastBlock)
+{
+    AggregateSource &entry = column.sources[source];
+    const int size = entry.values.size();
+    entry.blocks.resize((size + AggregateBlockSize - 1) / AggregateBlockSize);
+
+    if (lastBlock < 0 || lastBlock >= entry.blocks.size()) {
+        lastBlock = entry.blocks.size() - 1;
+    }
+    const double *values = entry.values.constData();
+    for (int i = firstBlock; i <= lastBlock; ++i) {
+        const int first = i * AggregateBlockSize;
+        entry.blocks[i].compute(values + first, qMin(AggregateBlockSize, size - first));
+    }
+
+    entry.total = AggregateBlock();
+    foreach (const AggregateBlock &block, entry.blocks) {
+        entry.total.merge(block);
+    }
+    column.total = AggregateBlock();
+    foreach (const AggregateSource &other, column.sources) {
+        column.total.merge(other.total);
+    }
+}
+
+void QMultiProxyModelPrivate::aggregatesRebuildSource(AggregateColumn &column, int source)
+{
+    const QAbstractItemModel *model = m_sourceModels.at(source);
+    const int rows = model->rowCount();
+    QVector<double> &values = column.sources[source].values;
+    values.resize(rows);
+    // The numeric columns of a QColumnarTableModel are copied without reading every cell.
+    const QColumnarTableModel *columnar = m_columnarSources.at(source);
+    const bool direct = columnar && !isDeduplicating()
+            && (column.role == Qt::DisplayRole || column.role == Qt::EditRole);
+    const double *doubles = direct ? columnar->doubleColumn(column.column) : 0;
+    const qint64 *integers = direct ? columnar->int64Column(column.column) : 0;
+
+    if (m_placeholders.contains(model)) {
+        values.fill(qQNaN());
+    } else if (doubles) {
+        std::copy(doubles, doubles + rows, values.begin());
+    } else if (integers) {
+        for (int row = 0; row < rows; ++row) {
+            values[row] = double(integers[row]);
+        }
+    } else if (isDeduplicating()) {
+        // Hidden rows don't contribute, so only the visible ones are read.
+        values.fill(qQNaN());
+        const DedupSource &entry = m_dedupSources.at(source);
+        int row = 0;
+        foreach (qint64 label, entry.visibleLabels) {
+            // The visible labels ascend, so every search starts at the previous row.
+            row = std::lower_bound(entry.labels.constBegin() + row, entry.labels.constEnd(), label) - entry.labels.constBegin();
+            values[row] = aggregateValue(column, source, row);
+        }
+    } else {
+        // QAbstractItemModel has no bulk read, so other models cost one data() call per row.
+        for (int row = 0; row < rows; ++row) {
+            values[row] = aggregateValue(column, source, row);
+        }
+    }
+    aggregatesRecompute(column, source, 0);
+}
+
+void QMultiProxyModelPrivate::rebuildAggregates()
+{
+    for (int c = 0; c < m_aggregateColumns.size(); ++c) {
+        AggregateColumn &column = m_aggregateColumns[c];
+        column.sources.clear();
+        column.total = AggregateBlock();
+        for (int i = 0; i < m_sourceModels.size(); ++i) {
+            column.sources.append(AggregateSource());
+            aggregatesRebuildSource(column, i);
+        }
+    }
+}
+
+void QMultiProxyModelPrivate::aggregatesRebuildSource(int source)
+{
+    for (int c = 0; c < m_aggregateColumns.size(); ++c) {
+        aggregatesRebuildSource(m_aggregateColumns[c], source);
+    }
+}
+
+/*!
+ * Extracts the values of the source model inserted at position \a source; the other sources are not read.
+ */
+void QMultiProxyModelPrivate::aggregatesInsertSource(int source)
+{
+    for (int c = 0; c < m_aggregateColumns.size(); ++c) {
+        AggregateColumn &column = m_aggregateColumns[c];
+        column.sources.insert(source, AggregateSource());
+        aggregatesRebuildSource(column, source);
+    }
+}
+
+/*!
+ * Drops the values of the source model at position \a source and merges the totals of the others again.
+ */
+void QMultiProxyModelPrivate::aggregatesRemoveSource(int source)
+{
+    for (int c = 0; c < m_aggregateColumns.size(); ++c) {
+        AggregateColumn &column = m_aggregateColumns[c];
+        column.sources.removeAt(source);
+        column.total = AggregateBlock();
+        foreach (const AggregateSource &other, column.sources) {
+            column.total.merge(other.total);
+        }
+    }
+}
+
+/*!
+ * Makes room for the rows inserted into the source at position \a source.
+ * In deduplication mode the new rows contribute nothing until they are shown.
+ */
+void QMultiProxyModelPrivate::aggregatesInsertRows(int source, int start, int end)
+{
+    for (int c = 0; c < m_aggregateColumns.size(); ++c) {
+        AggregateColumn &column = m_aggregateColumns[c];
+        QVector<double> &values = column.sources[source].values;
+        values.insert(start, end - start + 1, qQNaN());
+        if (!isDeduplicating()) {
+            for (int row = start; row <= end; ++row) {
+                values[row] = aggregateValue(column, source, row);
+            }
+        }
+        aggregatesRecompute(column, source, start / AggregateBlockSize);
+    }
+}
+
+void QMultiProxyModelPrivate::aggregatesRemoveRows(int source, int start, int end)
+{
+    for (int c = 0; c < m_aggregateColumns.size(); ++c) {
+        AggregateColumn &column = m_aggregateColumns[c];
+        column.sources[source].values.remove(start, end - start + 1);
+        aggregatesRecompute(column, source, start / AggregateBlockSize);
+    }
+}
+
+/*!
+ * Moves the values of the source rows from \a start to \a end before the row \a dest, like the
+ * source model did. A move doesn't change the values, so only the blocks in the moved range are
+ * recomputed. In deduplication mode the move may change the winners, so the source is read again.
+ */
+void QMultiProxyModelPrivate::aggregatesMoveRows(int source, int start, int end, int dest)
+{
+    if (isDeduplicating()) {
+        aggregatesRebuildSource(source);
+        return;
+    }
+
+    const int first = qMin(start, dest);
+    const int last = qMax(end + 1, dest) - 1;
+    for (int c = 0; c < m_aggregateColumns.size(); ++c) {
+        AggregateColumn &column = m_aggregateColumns[c];
+        QVector<double> &values = column.sources[source].values;
+        if (dest > end) {
+            std::rotate(values.begin() + start, values.begin() + end + 1, values.begin() + dest);
+        } else {
+            std::rotate(values.begin() + dest, values.begin() + start, values.begin() + end + 1);
+        }
+        aggregatesRecompute(column, source, first / AggregateBlockSize, last / AggregateBlockSize);
+    }
+}
+
+/*!
+ * Re-reads the values of the source rows from \a first to \a last in all aggregated columns.
+ */
+void QMultiProxyModelPrivate::aggregatesUpdateRows(int source, int first, int last)
+{
+    for (int c = 0; c < m_aggregateColumns.size(); ++c) {
+        AggregateColumn &column = m_aggregateColumns[c];
+        QVector<double> &values = column.sources[source].values;
+        for (int row = first; row <= last; ++row) {
+            values[row] = aggregateValue(column, source, row);
+        }
+        aggregatesRecompute(column, source, first / AggregateBlockSize, last / AggregateBlockSize);
+    }
+}
+
+/*!
+ * Re-reads the values of the given ascending source \a rows; every block they touch is recomputed once.
+ */
+void QMultiProxyModelPrivate::aggregatesUpdateRows(int source, const QVector<int> &rows)
+{
+    if (rows.isEmpty()) {
+        return;
+    }
+
+    for (int c = 0; c < m_aggregateColumns.size(); ++c) {
+        AggregateColumn &column = m_aggregateColumns[c];
+        QVector<double> &values = column.sources[source].values;
+        foreach (int row, rows) {
+            values[row] = aggregateValue(column, source, row);
+        }
+        int block = -1;
+        foreach (int row, rows) {
+            if (row / AggregateBlockSize != block) {
+                block = row / AggregateBlockSize;
+                aggregatesRecompute(column, source, block, block);
+            }
+        }
+    }
+}
+
+#if QT_VERSION < 0x050000
+void QMultiProxyModelPrivate::aggregatesDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+#else
+void QMultiProxyModelPrivate::aggregatesDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+#endif
+{
+    const int source = sourcePosition(topLeft.model());
+    if (source < 0) {
+        return;
+    }
+
+    for (int c = 0; c < m_aggregateColumns.size(); ++c) {
+        AggregateColumn &column = m_aggregateColumns[c];
+        if (column.column < topLeft.column() || column.column > bottomRight.column()) {
+            continue;
+        }
+#if QT_VERSION >= 0x050000
+        if (!roles.isEmpty() && !roles.contains(column.role)) {
+            continue;
+        }
+#endif
+        QVector<double> &values = column.sources[source].values;
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+            values[row] = aggregateValue(column, source, row);
+        }
+        aggregatesRecompute(column, source, topLeft.row() / AggregateBlockSize, bottomRight.row() / AggregateBlockSize);
+    }
+}
+
+/*!
+ * Publishes a snapshot when control returns to the event loop, so a burst of changes is published once.
+ */
+void QMultiProxyModelPrivate::schedulePublishSnapshot()
+{
+    Q_Q(QMultiProxyModel);
+    if (!m_snapshotsEnabled || m_snapshotPending) {
+        return;
+    }
+
+    m_snapshotPending = true;
+    QMetaObject::invokeMethod(q, "_q_publishSnapshot", Qt::QueuedConnection);
+}
+
+void QMultiProxyModelPrivate::publishSnapshot()
+{
+    m_snapshotPending = false;
+    if (!m_snapshotsEnabled) {
+        return;
+    }
+
+    QMultiProxyModelSnapshotData *data = new QMultiProxyModelSnapshotData;
+    data->offsets.reserve(m_sourceModels.size() + 1);
+    data->concurrentReadSafe.reserve(m_sourceModels.size());
+    int offset = 0;
+    for (int i = 0; i < m_sourceModels.size(); ++i) {
+        // Placeholders are internal and not thread-safe, a pending deferred source has no model yet.
+        QAbstractItemModel *model = m_sourceModels.at(i);
+        const bool placeholder = m_placeholders.contains(model);
+        data->sourceModels.append(placeholder ? 0 : model);
+        data->offsets.append(offset);
+        data->concurrentReadSafe.append(!placeholder && m_concurrentReadSafe.contains(model));
+        if (isDeduplicating()) {
+            data->labels.append(m_dedupSources.at(i).labels);
+            data->visibleLabels.append(m_dedupSources.at(i).visibleLabels);
+        }
+        offset += visibleRowCount(i);
+    }
+    data->offsets.append(offset);
+    if (isInterleaving()) {
+        data->interleaved = m_interleaved;
+    }
+
+    retireSnapshot(m_snapshot.fetchAndStoreOrdered(data));
+}
+
+/*!
+ * Queues the replaced snapshot \a data for deletion and deletes the queued snapshots that are
+ * no longer referenced.
+ */
+void QMultiProxyModelPrivate::retireSnapshot(QMultiProxyModelSnapshotData *data)
+{
+    if (data) {
+        m_retiredSnapshots.append(data);
+    }
+
+    // Readers pinning now can only load the current snapshot. A reader that loaded a retired
+    // one has either referenced it already or is still pinning, so try again next time.
+    if (loadOrdered(m_snapshotPins) != 0) {
+        return;
+    }
+    for (int i = m_retiredSnapshots.size() - 1; i >= 0; --i) {
+        if (loadOrdered(m_retiredSnapshots.at(i)->ref) == 0) {
+            delete m_retiredSnapshots.takeAt(i);
+        }
+    }
+}
+
+QMultiProxyModelPlaceholder *QMultiProxyModelPrivate::placeholderFor(const QMultiProxyModelDeferredSource *source) const
+{
+    foreach (QMultiProxyModelPlaceholder *placeholder, m_placeholders) {
+        if (placeholder->deferredSource() == source) {
+            return placeholder;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * Replaces the placeholder with the model created by its deferred source.
+ * The estimated row count is reconciled with the real one by inserting or removing the
+ * difference at the end of the range; the rows in common are reported as changed.
+ * In deduplication and interleave modes, or if the column count of the proxy model changes,
+ * the proxy model is reseted instead.
+ * \return Returns the created model, or 0 if the deferred source failed to create one;
+ * the placeholder is removed in that case.
+ */
+QAbstractItemModel *QMultiProxyModelPrivate::materialize(QMultiProxyModelPlaceholder *placeholder)
+{
+    Q_Q(QMultiProxyModel);
+    QAbstractItemModel *model = placeholder->deferredSource()->createSourceModel();
+    if (!model || m_sourceModels.contains(model)) {
+        q->removeSourceModel(placeholder);
+        return 0;
+    }
+
+    const int source = sourcePosition(placeholder);
+    const int offset = offsetForPosition(source);
+    const int estimate = placeholder->rowCount();
+    const int rows = model->rowCount();
+    // The proxy model takes its column count from the first source model.
+    const bool columnsChanged = source == 0 && model->columnCount() != placeholder->columnCount();
+    const bool reset = isDeduplicating() || isInterleaving() || columnsChanged;
+
+    if (reset) {
+        q->beginResetModel();
+    } else if (rows > estimate) {
+        q->beginInsertRows(QModelIndex(), offset + estimate, offset + rows - 1);
+    } else if (rows < estimate) {
+        q->beginRemoveRows(QModelIndex(), offset + rows, offset + estimate - 1);
+    }
+
+    q->disconnectSourceModel(placeholder);
+    m_placeholders.remove(placeholder);
+    m_sourceModels[source] = model;
+    updateColumnarSources();
+    q->connectSourceModel(model);
+    updateRolenames();
+    dedupRebuildSource(source);
+    interleaveRebuildSource(source);
+    aggregatesRebuildSource(source);
+    schedulePublishSnapshot();
+
+    if (reset) {
+        q->endResetModel();
+    } else if (rows > estimate) {
+        q->endInsertRows();
+    } else if (rows < estimate) {
+        q->endRemoveRows();
+    }
+    if (!reset && qMin(rows, estimate) > 0) {
+        emit q->dataChanged(q->index(offset, 0), q->index(offset + qMin(rows, estimate) - 1, q->columnCount() - 1));
+    }
+
+    delete placeholder;
+    return model;
+}
+
+/*!
+ * \todo In Qt5 we have no possibility to notify viewers about update of roleNames if the viewer has been using the proxy model.
+ * May be we can resetModel, but it's overhead.
+ * Anyway it's an expansion of functionality and not necessary now.
+ */
+void QMultiProxyModelPrivate::updateRolenames()
+{
+#if QT_VERSION < 0x050000
+    Q_Q(QMultiProxyModel);
+    QHash<int,QByteArray> allRoleNames = q->roleNames();
+    bool changed = false;
+#else
+    QHash<int,QByteArray> &allRoleNames = m_rolenames;
+#endif
+
+    foreach (QAbstractItemModel *model, m_sourceModels) {
+        const QHash<int,QByteArray> &modelRN = model->roleNames();
+        foreach (int role, modelRN.uniqueKeys()) {
+            if (!allRoleNames.contains(role) || allRoleNames.value(role) != modelRN.value(role) ) {
+#if QT_VERSION < 0x050000
+                changed = true;
+#endif
+                allRoleNames.insertMulti(role, modelRN.value(role));
+            }
+        }
+    }
+#if QT_VERSION < 0x050000
+    if (changed) {
+        q->setRoleNames(allRoleNames);
+    }
+#endif
+}
+
+void QMultiProxyModelPrivate::_q_rowsAboutToBeInserted(const QModelIndex &parent, int start, int end)
+{
+    Q_Q(QMultiProxyModel);
+    QAbstractItemModel *srcModel = qobject_cast<QAbstractItemModel*>(q->sender());
+    Q_ASSERT(srcModel);
+    Q_ASSERT(parent.isValid() ? parent.model() == srcModel : true);
+
+    if (isDeduplicating() || isInterleaving()) {
+        // The new rows are announced by _q_rowsInserted() once their keys can be read.
+        return;
+    }
 
     int offset = offsetForModel(srcModel);
     q->beginInsertRows(parent, offset+start, offset+end);
@@ -121,16 +1869,22 @@ void QMultiProxyModelPrivate::_q_rowsAboutToBeInserted(const QModelIndex &parent
 
 void QMultiProxyModelPrivate::_q_rowsInserted(const QModelIndex &parent, int start, int end)
 {
-    Q_UNUSED(start)
-    Q_UNUSED(end)
-
     Q_Q(QMultiProxyModel);
     updateRolenames();
     QAbstractItemModel *srcModel = qobject_cast<QAbstractItemModel*>(q->sender());
     Q_ASSERT(srcModel);
     Q_ASSERT(parent.isValid() ? parent.model() == srcModel : true);
 
-    q->endInsertRows();
+    const int source = sourcePosition(srcModel);
+    aggregatesInsertRows(source, start, end);
+    if (isDeduplicating()) {
+        dedupRowsInserted(source, start, end);
+    } else if (isInterleaving()) {
+        interleaveRowsInserted(source, start, end);
+    } else {
+        q->endInsertRows();
+    }
+    schedulePublishSnapshot();
 }
 
 void QMultiProxyModelPrivate::_q_rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
@@ -141,17 +1895,44 @@ void QMultiProxyModelPrivate::_q_rowsAboutToBeRemoved(const QModelIndex &parent,
     Q_ASSERT(parent.isValid() ? parent.model() == srcModel : true);
 
     int offset = offsetForModel(srcModel);
+    if (isDeduplicating()) {
+        const DedupSource &entry = m_dedupSources.at(sourcePosition(srcModel));
+        const QVector<qint64> &visible = entry.visibleLabels;
+        const int first = std::lower_bound(visible.constBegin(), visible.constEnd(), entry.labels.at(start)) - visible.constBegin();
+        const int last = std::upper_bound(visible.constBegin(), visible.constEnd(), entry.labels.at(end)) - visible.constBegin();
+        m_dedupRemovePending = first < last;
+        if (m_dedupRemovePending) {
+            q->beginRemoveRows(QModelIndex(), offset+first, offset+last-1);
+        }
+        return;
+    }
+    if (isInterleaving()) {
+        // The proxy rows may be scattered, so they are removed range by range right away.
+        interleaveRowsAboutToBeRemoved(sourcePosition(srcModel), start, end);
+        return;
+    }
+
     q->beginRemoveRows(q->mapFromSource(parent), offset+start, offset+end);
 }
 
 void QMultiProxyModelPrivate::_q_rowsRemoved(const QModelIndex &parent, int start, int end)
 {
     Q_UNUSED(parent)
-    Q_UNUSED(start)
-    Q_UNUSED(end)
 
     Q_Q(QMultiProxyModel);
-    q->endRemoveRows();
+    QAbstractItemModel *srcModel = qobject_cast<QAbstractItemModel*>(q->sender());
+    Q_ASSERT(srcModel);
+
+    const int source = sourcePosition(srcModel);
+    aggregatesRemoveRows(source, start, end);
+    if (isDeduplicating()) {
+        dedupRowsRemoved(source, start, end);
+    } else if (isInterleaving()) {
+        interleaveRowsRemoved(source, start, end);
+    } else {
+        q->endRemoveRows();
+    }
+    schedulePublishSnapshot();
 }
 
 void QMultiProxyModelPrivate::_q_rowsAboutToBeMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd, const QModelIndex &destParent, int dest)
@@ -162,22 +1943,36 @@ void QMultiProxyModelPrivate::_q_rowsAboutToBeMoved(const QModelIndex &sourcePar
     Q_ASSERT(sourceParent.isValid() ? sourceParent.model() == srcModel : true);
     Q_ASSERT(destParent.isValid() ? destParent.model() == srcModel : true);
 
+    if (isDeduplicating() || isInterleaving()) {
+        // Moved rows may change the winners or the merged order, so the index is rebuilt.
+        q->beginResetModel();
+        return;
+    }
+
     int offset = offsetForModel(srcModel);
     q->beginMoveRows(q->mapFromSource(sourceParent), offset+sourceStart, offset+sourceEnd, q->mapFromSource(destParent), offset+dest);
 }
 
 void QMultiProxyModelPrivate::_q_rowsMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd, const QModelIndex &destParent, int dest)
 {
-    Q_UNUSED(sourceStart)
-    Q_UNUSED(sourceEnd)
-    Q_UNUSED(dest)
-
     Q_Q(QMultiProxyModel);
     QAbstractItemModel *srcModel = qobject_cast<QAbstractItemModel*>(q->sender());
     Q_ASSERT(srcModel);
     Q_ASSERT(sourceParent.isValid() ? sourceParent.model() == srcModel : true);
     Q_ASSERT(destParent.isValid() ? destParent.model() == srcModel : true);
 
+    if (isDeduplicating() || isInterleaving()) {
+        const int source = sourcePosition(srcModel);
+        dedupRebuildSource(source);
+        interleaveRebuildSource(source);
+        aggregatesMoveRows(source, sourceStart, sourceEnd, dest);
+        schedulePublishSnapshot();
+        q->endResetModel();
+        return;
+    }
+
+    aggregatesMoveRows(sourcePosition(srcModel), sourceStart, sourceEnd, dest);
+    schedulePublishSnapshot();
     q->endMoveRows();
 }
 
@@ -201,6 +1996,8 @@ void QMultiProxyModelPrivate::_q_columnsInserted(const QModelIndex &parent, int
     Q_ASSERT(parent.isValid() ? parent.model() == srcModel : true);
 
     updateRolenames();
+    // The aggregates refer to column numbers, the values of the sender now belong to other columns.
+    aggregatesRebuildSource(sourcePosition(srcModel));
     q->endInsertColumns();
 }
 
@@ -223,6 +2020,7 @@ void QMultiProxyModelPrivate::_q_columnsRemoved(const QModelIndex &parent, int s
     Q_ASSERT(srcModel);
     Q_ASSERT(parent.isValid() ? parent.model() == srcModel : true);
 
+    aggregatesRebuildSource(sourcePosition(srcModel));
     q->endRemoveColumns();
 }
 
@@ -249,6 +2047,7 @@ void QMultiProxyModelPrivate::_q_columnsMoved(const QModelIndex &sourceParent, i
     Q_ASSERT(sourceParent.isValid() ? sourceParent.model() == srcModel : true);
     Q_ASSERT(destParent.isValid() ? destParent.model() == srcModel : true);
 
+    aggregatesRebuildSource(sourcePosition(srcModel));
     q->endMoveColumns();
 }
 
@@ -261,9 +2060,35 @@ void QMultiProxyModelPrivate::_q_modelAboutToBeReset()
 void QMultiProxyModelPrivate::_q_modelReset()
 {
     Q_Q(QMultiProxyModel);
+    // Only the sender is read again; winners it takes from or leaves to other sources are updated there.
+    const int source = sourcePosition(qobject_cast<QAbstractItemModel*>(q->sender()));
+    dedupRebuildSource(source);
+    interleaveRebuildSource(source);
+    aggregatesRebuildSource(source);
+    schedulePublishSnapshot();
     emit q->endResetModel();
 }
 
+void QMultiProxyModelPrivate::_q_publishSnapshot()
+{
+    // The snapshot may have been published right away in the meantime.
+    if (m_snapshotPending) {
+        publishSnapshot();
+    }
+}
+
+void QMultiProxyModelPrivate::_q_materializeRequested()
+{
+    // Views may remove deferred sources while handling the signals of materialize(),
+    // so every placeholder is looked up again before it's used.
+    const QList<QMultiProxyModelPlaceholder *> placeholders = m_placeholders.values();
+    foreach (QMultiProxyModelPlaceholder *placeholder, placeholders) {
+        if (m_placeholders.value(placeholder) == placeholder && placeholder->isRequested()) {
+            materialize(placeholder);
+        }
+    }
+}
+
 /*!
  * \todo I have no definite idea what to do if we have several models with different headers.
  * Perhaps we need to merge headers.
@@ -278,6 +2103,10 @@ void QMultiProxyModelPrivate::_q_headerDataChanged(Qt::Orientation orientation,
 void QMultiProxyModelPrivate::_q_layoutAboutToBeChanged()
 {
     Q_Q(QMultiProxyModel);
+    if (isInterleaving()) {
+        interleaveLayoutAboutToBeChanged();
+        return;
+    }
     emit q->layoutAboutToBeChanged();
 }
 #else
@@ -287,6 +2116,10 @@ void QMultiProxyModelPrivate::_q_layoutAboutToBeChanged(const QList<QPersistentM
     Q_UNUSED(hint)
 
     Q_Q(QMultiProxyModel);
+    if (isInterleaving()) {
+        interleaveLayoutAboutToBeChanged();
+        return;
+    }
     emit q->layoutAboutToBeChanged();
 }
 #endif
@@ -295,6 +2128,15 @@ void QMultiProxyModelPrivate::_q_layoutAboutToBeChanged(const QList<QPersistentM
 void QMultiProxyModelPrivate::_q_layoutChanged()
 {
     Q_Q(QMultiProxyModel);
+    const int source = sourcePosition(qobject_cast<QAbstractItemModel*>(q->sender()));
+    dedupRebuildSource(source);
+    interleaveRebuildSource(source);
+    aggregatesRebuildSource(source);
+    schedulePublishSnapshot();
+    if (isInterleaving()) {
+        interleaveLayoutChanged();
+        return;
+    }
     emit q->layoutChanged();
 }
 #else
@@ -304,6 +2146,15 @@ void QMultiProxyModelPrivate::_q_layoutChanged(const QList<QPersistentModelIndex
     Q_UNUSED(hint)
 
     Q_Q(QMultiProxyModel);
+    const int source = sourcePosition(qobject_cast<QAbstractItemModel*>(q->sender()));
+    dedupRebuildSource(source);
+    interleaveRebuildSource(source);
+    aggregatesRebuildSource(source);
+    schedulePublishSnapshot();
+    if (isInterleaving()) {
+        interleaveLayoutChanged();
+        return;
+    }
     emit q->layoutChanged();
 }
 #endif
@@ -314,6 +2165,33 @@ void QMultiProxyModelPrivate::_q_dataChanged(const QModelIndex &topLeft, const Q
     Q_Q(QMultiProxyModel);
     Q_ASSERT(topLeft.isValid() ? topLeft.model() != q : true);
     Q_ASSERT(bottomRight.isValid() ? bottomRight.model() != q : true);
+
+    if (isDeduplicating()) {
+        QModelIndex proxyTopLeft, proxyBottomRight;
+        // Snapshots hold no data, so only changed keys make them stale.
+        if (dedupSourceDataChanged(topLeft, bottomRight, true, &proxyTopLeft, &proxyBottomRight)) {
+            schedulePublishSnapshot();
+        }
+        aggregatesDataChanged(topLeft, bottomRight);
+        if (proxyTopLeft.isValid()) {
+            emit q->dataChanged(proxyTopLeft, proxyBottomRight);
+        }
+        return;
+    }
+
+    if (isInterleaving()) {
+        if (interleaveSourceDataChanged(topLeft, bottomRight, true)) {
+            schedulePublishSnapshot();
+        }
+        aggregatesDataChanged(topLeft, bottomRight);
+        typedef QPair<int, int> Range;
+        foreach (const Range &range, interleaveProxyRanges(sourcePosition(topLeft.model()), topLeft.row(), bottomRight.row())) {
+            emit q->dataChanged(q->index(range.first, topLeft.column()), q->index(range.second, bottomRight.column()));
+        }
+        return;
+    }
+
+    aggregatesDataChanged(topLeft, bottomRight);
     emit q->dataChanged(q->mapFromSource(topLeft), q->mapFromSource(bottomRight));
 }
 #else
@@ -322,209 +2200,593 @@ void QMultiProxyModelPrivate::_q_dataChanged(const QModelIndex &topLeft, const Q
     Q_Q(QMultiProxyModel);
     Q_ASSERT(topLeft.isValid() ? topLeft.model() != q : true);
     Q_ASSERT(bottomRight.isValid() ? bottomRight.model() != q : true);
+
+    if (isDeduplicating()) {
+        QModelIndex proxyTopLeft, proxyBottomRight;
+        const bool keysChanged = roles.isEmpty() || roles.contains(m_dedupRole);
+        // Snapshots hold no data, so only changed keys make them stale.
+        if (dedupSourceDataChanged(topLeft, bottomRight, keysChanged, &proxyTopLeft, &proxyBottomRight)) {
+            schedulePublishSnapshot();
+        }
+        aggregatesDataChanged(topLeft, bottomRight, roles);
+        if (proxyTopLeft.isValid()) {
+            emit q->dataChanged(proxyTopLeft, proxyBottomRight, roles);
+        }
+        return;
+    }
+
+    if (isInterleaving()) {
+        if (interleaveSourceDataChanged(topLeft, bottomRight, roles.isEmpty() || roles.contains(m_interleaveRole))) {
+            schedulePublishSnapshot();
+        }
+        aggregatesDataChanged(topLeft, bottomRight, roles);
+        typedef QPair<int, int> Range;
+        foreach (const Range &range, interleaveProxyRanges(sourcePosition(topLeft.model()), topLeft.row(), bottomRight.row())) {
+            emit q->dataChanged(q->index(range.first, topLeft.column()), q->index(range.second, bottomRight.column()), roles);
+        }
+        return;
+    }
+
+    aggregatesDataChanged(topLeft, bottomRight, roles);
     emit q->dataChanged(q->mapFromSource(topLeft), q->mapFromSource(bottomRight), roles);
 }
-#endif
+#endif
+
+/*!
+    \class QMultiProxyModel
+    \brief The QMultiProxyModel class provides several item models as one model.
+    \ingroup model-view
+
+    \note If the source model is deleted or no source model is specified, the
+    proxy model operates on a empty placeholder model.
+    \sa QSortFilterProxyModel, QAbstractItemModel, {Model/View Programming}
+*/
+
+/*!
+ * \brief Constructs a proxy model with the given parent.
+ */
+QMultiProxyModel::QMultiProxyModel(QObject *parent) :
+    QAbstractProxyModel(parent),
+    d_ptr(new QMultiProxyModelPrivate(this))
+{
+
+}
+
+/*!
+ * \brief Destroys the proxy model.
+ */
+QMultiProxyModel::~QMultiProxyModel()
+{
+    delete d_ptr;
+}
+
+/*!
+ *  \brief Returns the models that contains the data that is available through the proxy model.
+ *  \return List of models
+ */
+QList<QAbstractItemModel *> QMultiProxyModel::sourceModels()
+{
+    Q_D(QMultiProxyModel);
+    if (d->m_placeholders.isEmpty()) {
+        return d->m_sourceModels;
+    }
+
+    QList<QAbstractItemModel *> models;
+    foreach (QAbstractItemModel *model, d->m_sourceModels) {
+        if (!d->m_placeholders.contains(model)) {
+            models.append(model);
+        }
+    }
+    return models;
+}
+
+/*!
+ * Connects the signals of the given source \a model to the private slots.
+ */
+void QMultiProxyModel::connectSourceModel(QAbstractItemModel *model)
+{
+    connect(model, SIGNAL(rowsAboutToBeInserted(QModelIndex,int,int)),
+            SLOT(_q_rowsAboutToBeInserted(QModelIndex,int,int)));
+    connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)),
+            SLOT(_q_rowsInserted(QModelIndex,int,int)));
+    connect(model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)),
+            SLOT(_q_rowsAboutToBeRemoved(QModelIndex,int,int)));
+    connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)),
+            SLOT(_q_rowsRemoved(QModelIndex,int,int)));
+    connect(model, SIGNAL(rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
+            SLOT(_q_rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)));
+    connect(model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
+            SLOT(_q_rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+    connect(model, SIGNAL(columnsAboutToBeInserted(QModelIndex,int,int)),
+            SLOT(_q_columnsAboutToBeInserted(QModelIndex,int,int)));
+    connect(model, SIGNAL(columnsInserted(QModelIndex,int,int)),
+            SLOT(_q_columnsInserted(QModelIndex,int,int)));
+    connect(model, SIGNAL(columnsAboutToBeRemoved(QModelIndex,int,int)),
+            SLOT(_q_columnsAboutToBeRemoved(QModelIndex,int,int)));
+    connect(model, SIGNAL(columnsRemoved(QModelIndex,int,int)),
+            SLOT(_q_columnsRemoved(QModelIndex,int,int)));
+    connect(model, SIGNAL(columnsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
+            SLOT(_q_columnsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)));
+    connect(model, SIGNAL(columnsMoved(QModelIndex,int,int,QModelIndex,int)),
+            SLOT(_q_columnsMoved(QModelIndex,int,int,QModelIndex,int)));
+
+    connect(model, SIGNAL(modelAboutToBeReset()),
+            SLOT(_q_modelAboutToBeReset()));
+    connect(model, SIGNAL(modelReset()),
+            SLOT(_q_modelReset()));
+    connect(model, SIGNAL(headerDataChanged(Qt::Orientation,int,int)),
+            SLOT(_q_headerDataChanged(Qt::Orientation,int,int)));
+
+#if QT_VERSION < 0x050000
+    connect(model, SIGNAL(layoutAboutToBeChanged()),
+            SLOT(_q_layoutAboutToBeChanged()));
+    connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
+            SLOT(_q_dataChanged(QModelIndex,QModelIndex)));
+    connect(model, SIGNAL(layoutChanged()),
+            SLOT(_q_layoutChanged()));
+#else
+    connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)),
+            SLOT(_q_dataChanged(QModelIndex,QModelIndex,QVector<int>)));
+    connect(model, SIGNAL(layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
+            SLOT(_q_layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)));
+    connect(model, SIGNAL(layoutChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
+            SLOT(_q_layoutChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)));
+#endif
+}
+
+/*!
+ * Disconnects the signals of the given source \a model from the private slots.
+ */
+void QMultiProxyModel::disconnectSourceModel(QAbstractItemModel *model)
+{
+    disconnect(model, SIGNAL(rowsAboutToBeInserted(QModelIndex,int,int)),
+               this, SLOT(_q_rowsAboutToBeInserted(QModelIndex,int,int)));
+    disconnect(model, SIGNAL(rowsInserted(QModelIndex,int,int)),
+               this, SLOT(_q_rowsInserted(QModelIndex,int,int)));
+    disconnect(model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)),
+               this, SLOT(_q_rowsAboutToBeRemoved(QModelIndex,int,int)));
+    disconnect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)),
+               this, SLOT(_q_rowsRemoved(QModelIndex,int,int)));
+    disconnect(model, SIGNAL(rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
+               this, SLOT(_q_rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)));
+    disconnect(model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
+               this, SLOT(_q_rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+    disconnect(model, SIGNAL(columnsAboutToBeInserted(QModelIndex,int,int)),
+               this, SLOT(_q_columnsAboutToBeInserted(QModelIndex,int,int)));
+    disconnect(model, SIGNAL(columnsInserted(QModelIndex,int,int)),
+               this, SLOT(_q_columnsInserted(QModelIndex,int,int)));
+    disconnect(model, SIGNAL(columnsAboutToBeRemoved(QModelIndex,int,int)),
+               this, SLOT(_q_columnsAboutToBeRemoved(QModelIndex,int,int)));
+    disconnect(model, SIGNAL(columnsRemoved(QModelIndex,int,int)),
+               this, SLOT(_q_columnsRemoved(QModelIndex,int,int)));
+    disconnect(model, SIGNAL(columnsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
+               this, SLOT(_q_columnsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)));
+    disconnect(model, SIGNAL(columnsMoved(QModelIndex,int,int,QModelIndex,int)),
+               this, SLOT(_q_columnsMoved(QModelIndex,int,int,QModelIndex,int)));
+
+    disconnect(model, SIGNAL(modelAboutToBeReset()),
+               this, SLOT(_q_modelAboutToBeReset()));
+    disconnect(model, SIGNAL(modelReset()),
+               this, SLOT(_q_modelReset()));
+    disconnect(model, SIGNAL(headerDataChanged(Qt::Orientation,int,int)),
+               this, SLOT(_q_headerDataChanged(Qt::Orientation,int,int)));
+
+#if QT_VERSION < 0x050000
+    disconnect(model, SIGNAL(layoutAboutToBeChanged()),
+               this, SLOT(_q_layoutAboutToBeChanged()));
+    disconnect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
+               this, SLOT(_q_dataChanged(QModelIndex,QModelIndex)));
+    disconnect(model, SIGNAL(layoutChanged()),
+               this, SLOT(_q_layoutChanged()));
+#else
+    disconnect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)),
+               this, SLOT(_q_dataChanged(QModelIndex,QModelIndex,QVector<int>)));
+    disconnect(model, SIGNAL(layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
+               this, SLOT(_q_layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)));
+    disconnect(model, SIGNAL(layoutChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
+               this, SLOT(_q_layoutChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)));
+#endif
+}
+
+/*!
+ * \brief Adds the given source model into list for processing by the proxy model.
+ * \note Source models will be provided in the order they were added.
+ * \param model
+ * \return Returns false if the given model is NULL or already contained in the model's list; otherwise returns true.
+ */
+bool QMultiProxyModel::addSourceModel(QAbstractItemModel *model)
+{
+    Q_D(QMultiProxyModel);
+
+    if (!model || d->m_sourceModels.contains(model)) {
+        return false;
+    }
+
+    beginResetModel();
+    d->m_sourceModels.append(model);
+    d->updateColumnarSources();
+    d->updateRolenames();
+    // The new source has the lowest precedence, so it can't hide rows of the others.
+    const int source = d->m_sourceModels.size() - 1;
+    d->dedupInsertSource(source);
+    d->interleaveInsertSource(source);
+    d->aggregatesInsertSource(source);
+    d->schedulePublishSnapshot();
+
+    connectSourceModel(model);
+
+    endResetModel();
+
+    return true;
+}
+
+/*!
+ * \brief Removes the given source model from the model's list.
+ * \note The proxy model will be reseted.
+ * \param model
+ * \return Returns true if the proxy model contains an occurrence of the given model; otherwise returns false.
+ */
+bool QMultiProxyModel::removeSourceModel(QAbstractItemModel *model)
+{
+    Q_D(QMultiProxyModel);
+    if (d->m_sourceModels.contains(model)) {
+        beginResetModel();
+
+        if (model) {
+            disconnectSourceModel(model);
+        }
+        const int source = d->sourcePosition(model);
+        d->dedupRemoveSource(source);
+        d->interleaveRemoveSource(source);
+        d->aggregatesRemoveSource(source);
+        d->m_sourceModels.removeAll(model);
+        d->updateColumnarSources();
+        delete d->m_placeholders.take(model);
+        d->m_concurrentReadSafe.remove(model);
+        d->publishSnapshot();
+        endResetModel();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief Adds a source model which is created only when its rows are first read.
+ *
+ * Until then the proxy model provides \l{QMultiProxyModelDeferredSource::estimatedRowCount()}{estimated}
+ * empty rows for it. When a view reads any of them, the deferred source creates the model and the
+ * estimate is reconciled with the real row count by the minimal row insertion or removal.
+ * \note The proxy model does not take ownership of \a source, which must stay alive until it's materialized or removed.
+ * Neither does it take ownership of the model returned by QMultiProxyModelDeferredSource::createSourceModel();
+ * like any other source model, it must be deleted by the application, for example by giving it a parent.
+ * \return Returns false if the given source is NULL or already added; otherwise returns true.
+ * \sa materializeDeferredSourceModel(), removeDeferredSourceModel()
+ */
+bool QMultiProxyModel::addDeferredSourceModel(QMultiProxyModelDeferredSource *source)
+{
+    Q_D(QMultiProxyModel);
+    if (!source || d->placeholderFor(source)) {
+        return false;
+    }
+
+    QMultiProxyModelPlaceholder *placeholder = new QMultiProxyModelPlaceholder(source, this);
+    d->m_placeholders.insert(placeholder, placeholder);
+    return addSourceModel(placeholder);
+}
+
+/*!
+ * \brief Creates the source model of the given deferred \a source right away.
+ * \return Returns the created model, or 0 if the source is not pending or failed to create a model.
+ */
+QAbstractItemModel *QMultiProxyModel::materializeDeferredSourceModel(QMultiProxyModelDeferredSource *source)
+{
+    Q_D(QMultiProxyModel);
+    QMultiProxyModelPlaceholder *placeholder = d->placeholderFor(source);
+    return placeholder ? d->materialize(placeholder) : 0;
+}
+
+/*!
+ * \brief Removes the given deferred \a source if it has not been materialized yet.
+ * \note The proxy model will be reseted.
+ * \return Returns true if the source was pending; otherwise returns false.
+ */
+bool QMultiProxyModel::removeDeferredSourceModel(QMultiProxyModelDeferredSource *source)
+{
+    Q_D(QMultiProxyModel);
+    QMultiProxyModelPlaceholder *placeholder = d->placeholderFor(source);
+    return placeholder ? removeSourceModel(placeholder) : false;
+}
+
+/*!
+ * \brief Clear the model's list.
+ * \sa removeSourceModel()
+ * \todo Don't reset the proxy model every iteration
+ */
+void QMultiProxyModel::clearSourceModelsList()
+{
+    Q_D(QMultiProxyModel);
+    foreach (QAbstractItemModel *model, d->m_sourceModels) {
+        removeSourceModel(model);
+    }
+}
+
+/*!
+ * \param model
+ * \return Returns true if the proxy model contains an occurrence of the given model; otherwise returns false.
+ */
+bool QMultiProxyModel::containsSourceModel(QAbstractItemModel *model)
+{
+    Q_D(QMultiProxyModel);
+    return d->m_sourceModels.contains(model);
+}
+
+/*!
+ * \brief Collapses source rows that share the same value of the given \a role in column 0.
+ *
+ * Only one row per key is provided by the proxy model. Source models take precedence in the
+ * order they were added, and within a source model the first row wins. When the winning row is
+ * removed or its key changes, the next row with that key takes its place.
+ * Rows without a valid key are never collapsed.
+ *
+ * The keys are kept in a hash index that is updated incrementally on source changes.
+ * The deduplication is suspended while the rows are interleaved.
+ * Pass a negative \a role to disable the deduplication.
+ * \note The proxy model will be reseted.
+ */
+void QMultiProxyModel::setDeduplicationRole(int role)
+{
+    Q_D(QMultiProxyModel);
+    if (role < 0) {
+        role = -1;
+    }
+    if (d->m_dedupRole == role) {
+        return;
+    }
+
+    beginResetModel();
+    d->m_dedupRole = role;
+    d->rebuildDedupIndex();
+    d->rebuildAggregates();
+    d->schedulePublishSnapshot();
+    endResetModel();
+}
 
 /*!
-    \class QMultiProxyModel
-    \brief The QMultiProxyModel class provides several item models as one model.
-    \ingroup model-view
-
-    \note If the source model is deleted or no source model is specified, the
-    proxy model operates on a empty placeholder model.
-    \sa QSortFilterProxyModel, QAbstractItemModel, {Model/View Programming}
-*/
+ * \return Returns the role the source rows are deduplicated by, or -1 if the deduplication is disabled.
+ * \sa setDeduplicationRole()
+ */
+int QMultiProxyModel::deduplicationRole() const
+{
+    Q_D(const QMultiProxyModel);
+    return d->m_dedupRole;
+}
 
 /*!
- * \brief Constructs a proxy model with the given parent.
+ * \brief Interleaves the rows of all source models by the value of the given \a role in column 0.
+ *
+ * Every source model is expected to be sorted by the role in ascending order, like log records
+ * by their timestamp. The proxy model merges them into one ordered stream; rows with equal keys
+ * are ordered by the position of their source model. Numbers and dates are supported as keys.
+ * A row without a key or out of the order of its source model stays next to its predecessor.
+ *
+ * The merged order is kept in a mapping array. Inserted rows are placed by binary search, and
+ * rows appended with keys not less than the last proxy row are appended to the mapping as one block.
+ * Rows inserted into or removed from a source before its end renumber the following rows of that
+ * source in the mapping, which scans the whole mapping: O(all rows) per change.
+ * While read snapshots are enabled the mapping is copied once per published snapshot, see setReadSnapshotsEnabled().
+ * Pass a negative \a role to concatenate the source models again.
+ * \note The proxy model will be reseted.
+ * \sa setDeduplicationRole()
  */
-QMultiProxyModel::QMultiProxyModel(QObject *parent) :
-    QAbstractProxyModel(parent),
-    d_ptr(new QMultiProxyModelPrivate(this))
+void QMultiProxyModel::setInterleaveRole(int role)
 {
+    Q_D(QMultiProxyModel);
+    if (role < 0) {
+        role = -1;
+    }
+    if (d->m_interleaveRole == role) {
+        return;
+    }
 
+    beginResetModel();
+    d->m_interleaveRole = role;
+    d->rebuildDedupIndex();
+    d->rebuildInterleave();
+    d->rebuildAggregates();
+    d->schedulePublishSnapshot();
+    endResetModel();
 }
 
 /*!
- * \brief Destroys the proxy model.
+ * \return Returns the role the source rows are interleaved by, or -1 if the source models are concatenated.
+ * \sa setInterleaveRole()
  */
-QMultiProxyModel::~QMultiProxyModel()
+int QMultiProxyModel::interleaveRole() const
 {
-
+    Q_D(const QMultiProxyModel);
+    return d->m_interleaveRole;
 }
 
 /*!
- *  \brief Returns the models that contains the data that is available through the proxy model.
- *  \return List of models
+ * \brief Registers an aggregate of the values of the given \a role in \a column over all proxy rows.
+ *
+ * Values which can't be converted to a number are skipped. The aggregates are kept per source
+ * model and per block of rows and are updated incrementally when the source models change,
+ * so aggregate() is cheap to call after every change.
+ * \return Returns the identifier of the aggregate, or -1 if \a column is negative.
+ * \sa aggregate(), removeAggregate()
  */
-QList<QAbstractItemModel *> QMultiProxyModel::sourceModels()
+int QMultiProxyModel::addAggregate(int column, int role, AggregateType type)
 {
     Q_D(QMultiProxyModel);
-    return d->m_sourceModels;
+    if (column < 0) {
+        return -1;
+    }
+
+    int position = 0;
+    while (position < d->m_aggregateColumns.size()
+           && (d->m_aggregateColumns.at(position).column != column || d->m_aggregateColumns.at(position).role != role)) {
+        ++position;
+    }
+    if (position == d->m_aggregateColumns.size()) {
+        QMultiProxyModelPrivate::AggregateColumn aggregateColumn(column, role);
+        for (int i = 0; i < d->m_sourceModels.size(); ++i) {
+            aggregateColumn.sources.append(QMultiProxyModelPrivate::AggregateSource());
+            d->aggregatesRebuildSource(aggregateColumn, i);
+        }
+        d->m_aggregateColumns.append(aggregateColumn);
+    }
+    ++d->m_aggregateColumns[position].users;
+
+    QMultiProxyModelPrivate::Aggregate aggregate;
+    aggregate.column = position;
+    aggregate.type = type;
+    const int id = d->m_nextAggregateId++;
+    d->m_aggregates.insert(id, aggregate);
+    return id;
 }
 
 /*!
- * \brief Adds the given source model into list for processing by the proxy model.
- * \note Source models will be provided in the order they were added.
- * \param model
- * \return Returns false if the given model is NULL or already contained in the model's list; otherwise returns true.
+ * \brief Removes the aggregate with the given \a id.
+ * \return Returns false if there is no such aggregate; otherwise returns true.
  */
-bool QMultiProxyModel::addSourceModel(QAbstractItemModel *model)
+bool QMultiProxyModel::removeAggregate(int id)
 {
     Q_D(QMultiProxyModel);
-
-    if (!model || d->m_sourceModels.contains(model)) {
+    if (!d->m_aggregates.contains(id)) {
         return false;
     }
 
-    beginResetModel();
-    d->m_sourceModels.append(model);
-    d->updateRolenames();
-
-    connect(model, SIGNAL(rowsAboutToBeInserted(QModelIndex,int,int)),
-            SLOT(_q_rowsAboutToBeInserted(QModelIndex,int,int)));
-    connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)),
-            SLOT(_q_rowsInserted(QModelIndex,int,int)));
-    connect(model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)),
-            SLOT(_q_rowsAboutToBeRemoved(QModelIndex,int,int)));
-    connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)),
-            SLOT(_q_rowsRemoved(QModelIndex,int,int)));
-    connect(model, SIGNAL(rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
-            SLOT(_q_rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)));
-    connect(model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
-            SLOT(_q_rowsMoved(QModelIndex,int,int,QModelIndex,int)));
-    connect(model, SIGNAL(columnsAboutToBeInserted(QModelIndex,int,int)),
-            SLOT(_q_columnsAboutToBeInserted(QModelIndex,int,int)));
-    connect(model, SIGNAL(columnsInserted(QModelIndex,int,int)),
-            SLOT(_q_columnsInserted(QModelIndex,int,int)));
-    connect(model, SIGNAL(columnsAboutToBeRemoved(QModelIndex,int,int)),
-            SLOT(_q_columnsAboutToBeRemoved(QModelIndex,int,int)));
-    connect(model, SIGNAL(columnsRemoved(QModelIndex,int,int)),
-            SLOT(_q_columnsRemoved(QModelIndex,int,int)));
-    connect(model, SIGNAL(columnsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
-            SLOT(_q_columnsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)));
-    connect(model, SIGNAL(columnsMoved(QModelIndex,int,int,QModelIndex,int)),
-            SLOT(_q_columnsMoved(QModelIndex,int,int,QModelIndex,int)));
-
-    connect(model, SIGNAL(modelAboutToBeReset()),
-            SLOT(_q_modelAboutToBeReset()));
-    connect(model, SIGNAL(modelReset()),
-            SLOT(_q_modelReset()));
-    connect(model, SIGNAL(headerDataChanged(Qt::Orientation,int,int)),
-            SLOT(_q_headerDataChanged(Qt::Orientation,int,int)));
+    const int position = d->m_aggregates.take(id).column;
+    if (--d->m_aggregateColumns[position].users > 0) {
+        return true;
+    }
 
-#if QT_VERSION < 0x050000
-    connect(model, SIGNAL(layoutAboutToBeChanged()),
-            SLOT(_q_layoutAboutToBeChanged()));
-    connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
-            SLOT(_q_dataChanged(QModelIndex,QModelIndex)));
-    connect(model, SIGNAL(layoutChanged()),
-            SLOT(_q_layoutChanged()));
-#else
-    connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)),
-            SLOT(_q_dataChanged(QModelIndex,QModelIndex,QVector<int>)));
-    connect(model, SIGNAL(layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
-            SLOT(_q_layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)));
-    connect(model, SIGNAL(layoutChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
-            SLOT(_q_layoutChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)));
-#endif
+    d->m_aggregateColumns.removeAt(position);
+    QHash<int, QMultiProxyModelPrivate::Aggregate>::iterator it = d->m_aggregates.begin();
+    const QHash<int, QMultiProxyModelPrivate::Aggregate>::iterator end = d->m_aggregates.end();
+    for ( ; it != end; ++it) {
+        if (it.value().column > position) {
+            --it.value().column;
+        }
+    }
+    return true;
+}
 
-    endResetModel();
+/*!
+ * \brief Returns the current value of the aggregate with the given \a id.
+ *
+ * The count is returned as int, the other aggregates as double. The minimum, maximum and
+ * average are invalid while there are no numeric values, as is the result for an unknown \a id.
+ */
+QVariant QMultiProxyModel::aggregate(int id) const
+{
+    Q_D(const QMultiProxyModel);
+    QHash<int, QMultiProxyModelPrivate::Aggregate>::const_iterator it = d->m_aggregates.constFind(id);
+    if (it == d->m_aggregates.constEnd()) {
+        return QVariant();
+    }
 
-    return true;
+    const QMultiProxyModelPrivate::AggregateBlock &total = d->m_aggregateColumns.at(it.value().column).total;
+    switch (it.value().type) {
+    case CountAggregate:
+        return total.count;
+    case SumAggregate:
+        return total.sum;
+    case MinimumAggregate:
+        return total.count ? QVariant(total.minimum) : QVariant();
+    case MaximumAggregate:
+        return total.count ? QVariant(total.maximum) : QVariant();
+    case AverageAggregate:
+        return total.count ? QVariant(total.sum / total.count) : QVariant();
+    }
+    return QVariant();
 }
 
 /*!
- * \brief Removes the given source model from the model's list.
- * \note The proxy model will be reseted.
- * \param model
- * \return Returns true if the proxy model contains an occurrence of the given model; otherwise returns false.
+ * \brief Enables or disables the publication of read snapshots.
+ *
+ * While enabled, an immutable snapshot of the source models and their row offsets is published
+ * so readSnapshot() can be called from any thread. Structural changes are collected and published
+ * once when control returns to the event loop; data changes that move no row publish nothing.
+ * \note A snapshot shares the row mapping of the proxy model, so the next structural change
+ * copies the mapping: the visible rows of the changed source in deduplication mode, and the whole
+ * merged order in interleave mode. With snapshots enabled, this costs O(n) in the number of rows
+ * copied once per published snapshot, however many changes it collects.
+ * \sa readSnapshot(), setSourceModelConcurrentReadSafe()
  */
-bool QMultiProxyModel::removeSourceModel(QAbstractItemModel *model)
+void QMultiProxyModel::setReadSnapshotsEnabled(bool enabled)
 {
     Q_D(QMultiProxyModel);
-    if (d->m_sourceModels.contains(model)) {
-        beginResetModel();
-
-        if (model) {
-            disconnect(model, SIGNAL(rowsAboutToBeInserted(QModelIndex,int,int)),
-                       this, SLOT(_q_rowsAboutToBeInserted(QModelIndex,int,int)));
-            disconnect(model, SIGNAL(rowsInserted(QModelIndex,int,int)),
-                       this, SLOT(_q_rowsInserted(QModelIndex,int,int)));
-            disconnect(model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)),
-                       this, SLOT(_q_rowsAboutToBeRemoved(QModelIndex,int,int)));
-            disconnect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)),
-                       this, SLOT(_q_rowsRemoved(QModelIndex,int,int)));
-            disconnect(model, SIGNAL(rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
-                       this, SLOT(_q_rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)));
-            disconnect(model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)),
-                       this, SLOT(_q_rowsMoved(QModelIndex,int,int,QModelIndex,int)));
-            disconnect(model, SIGNAL(columnsAboutToBeInserted(QModelIndex,int,int)),
-                       this, SLOT(_q_columnsAboutToBeInserted(QModelIndex,int,int)));
-            disconnect(model, SIGNAL(columnsInserted(QModelIndex,int,int)),
-                       this, SLOT(_q_columnsInserted(QModelIndex,int,int)));
-            disconnect(model, SIGNAL(columnsAboutToBeRemoved(QModelIndex,int,int)),
-                       this, SLOT(_q_columnsAboutToBeRemoved(QModelIndex,int,int)));
-            disconnect(model, SIGNAL(columnsRemoved(QModelIndex,int,int)),
-                       this, SLOT(_q_columnsRemoved(QModelIndex,int,int)));
-            disconnect(model, SIGNAL(columnsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)),
-                       this, SLOT(_q_columnsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)));
-            disconnect(model, SIGNAL(columnsMoved(QModelIndex,int,int,QModelIndex,int)),
-                       this, SLOT(_q_columnsMoved(QModelIndex,int,int,QModelIndex,int)));
-
-            disconnect(model, SIGNAL(modelAboutToBeReset()),
-                       this, SLOT(_q_modelAboutToBeReset()));
-            disconnect(model, SIGNAL(modelReset()),
-                       this, SLOT(_q_modelReset()));
-            disconnect(model, SIGNAL(headerDataChanged(Qt::Orientation,int,int)),
-                       this, SLOT(_q_headerDataChanged(Qt::Orientation,int,int)));
+    if (d->m_snapshotsEnabled == enabled) {
+        return;
+    }
 
-#if QT_VERSION < 0x050000
-            disconnect(model, SIGNAL(layoutAboutToBeChanged()),
-                       this, SLOT(_q_layoutAboutToBeChanged()));
-            disconnect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
-                       this, SLOT(_q_dataChanged(QModelIndex,QModelIndex)));
-            disconnect(model, SIGNAL(layoutChanged()),
-                       this, SLOT(_q_layoutChanged()));
-#else
-            disconnect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)),
-                       this, SLOT(_q_dataChanged(QModelIndex,QModelIndex,QVector<int>)));
-            disconnect(model, SIGNAL(layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
-                       this, SLOT(_q_layoutAboutToBeChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)));
-            disconnect(model, SIGNAL(layoutChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)),
-                       this, SLOT(_q_layoutChanged(QList<QPersistentModelIndex>,QAbstractItemModel::LayoutChangeHint)));
-#endif
-        }
-        d->m_sourceModels.removeAll(model);
-        endResetModel();
+    d->m_snapshotsEnabled = enabled;
+    if (enabled) {
+        d->publishSnapshot();
     } else {
-        return false;
+        d->retireSnapshot(d->m_snapshot.fetchAndStoreOrdered(0));
     }
-    return true;
+}
+
+bool QMultiProxyModel::readSnapshotsEnabled() const
+{
+    Q_D(const QMultiProxyModel);
+    return d->m_snapshotsEnabled;
 }
 
 /*!
- * \brief Clear the model's list.
- * \sa removeSourceModel()
- * \todo Don't reset the proxy model every iteration
+ * \brief Marks the given source \a model as safe for data() calls from worker threads.
+ *
+ * Only the data of safe source models is provided by QMultiProxyModelSnapshot::data().
+ * It's up to the source model to allow concurrent reads while it's being updated.
+ * \return Returns false if the proxy model does not contain the given model; otherwise returns true.
  */
-void QMultiProxyModel::clearSourceModelsList()
+bool QMultiProxyModel::setSourceModelConcurrentReadSafe(QAbstractItemModel *model, bool safe)
 {
     Q_D(QMultiProxyModel);
-    foreach (QAbstractItemModel *model, d->m_sourceModels) {
-        removeSourceModel(model);
+    if (!d->m_sourceModels.contains(model)) {
+        return false;
+    }
+
+    if (safe) {
+        d->m_concurrentReadSafe.insert(model);
+    } else {
+        d->m_concurrentReadSafe.remove(model);
     }
+    d->publishSnapshot();
+    return true;
+}
+
+bool QMultiProxyModel::isSourceModelConcurrentReadSafe(QAbstractItemModel *model) const
+{
+    Q_D(const QMultiProxyModel);
+    return d->m_concurrentReadSafe.contains(model);
 }
 
 /*!
- * \param model
- * \return Returns true if the proxy model contains an occurrence of the given model; otherwise returns false.
+ * \brief Returns the latest published snapshot.
+ *
+ * This function is thread-safe and never blocks. The snapshot is invalid if the read snapshots
+ * are disabled. Called from the thread of the proxy model, it publishes pending changes first;
+ * other threads get the snapshot published at the last pass of the event loop.
+ * \note Snapshots must not outlive the proxy model, and the source models they refer to must
+ * not be deleted while the snapshots are in use.
+ * \sa setReadSnapshotsEnabled()
  */
-bool QMultiProxyModel::containsSourceModel(QAbstractItemModel *model)
+QMultiProxyModelSnapshot QMultiProxyModel::readSnapshot() const
 {
-    Q_D(QMultiProxyModel);
-    return d->m_sourceModels.contains(model);
+    Q_D(const QMultiProxyModel);
+    // The pending flag is only touched by the thread of the proxy model.
+    if (QThread::currentThread() == thread() && d->m_snapshotPending) {
+        const_cast<QMultiProxyModelPrivate *>(d)->publishSnapshot();
+    }
+    d->m_snapshotPins.ref();
+    const QMultiProxyModelSnapshot snapshot(loadOrdered(d->m_snapshot));
+    d->m_snapshotPins.deref();
+    return snapshot;
 }
 
 /*!
@@ -533,11 +2795,19 @@ bool QMultiProxyModel::containsSourceModel(QAbstractItemModel *model)
 QVariant QMultiProxyModel::data(const QModelIndex &proxyIndex, int role) const
 {
     Q_D(const QMultiProxyModel);
-    const QAbstractItemModel *model = d->sourceModelByProxyRow(proxyIndex.row());
-    if (!model) {
+    int source = -1;
+    const int sourceRow = d->sourceRowByProxyRow(proxyIndex.row(), &source);
+    if (sourceRow < 0) {
         return QVariant();
     }
-    return model->data(mapToSource(proxyIndex), role);
+
+    const QColumnarTableModel *columnar = d->m_columnarSources.at(source);
+    if (columnar && (role == Qt::DisplayRole || role == Qt::EditRole)) {
+        return columnar->value(sourceRow, proxyIndex.column());
+    }
+
+    const QAbstractItemModel *model = d->m_sourceModels.at(source);
+    return model->data(model->index(sourceRow, proxyIndex.column()), role);
 }
 
 /*!
@@ -550,9 +2820,21 @@ QModelIndex QMultiProxyModel::mapToSource(const QModelIndex &proxyIndex) const
     Q_ASSERT(proxyIndex.model() == this);
 
     Q_D(const QMultiProxyModel);
+    if (d->isInterleaving()) {
+        if (proxyIndex.row() >= d->m_interleaved.size()) {
+            return QModelIndex();
+        }
+        const QMultiProxyModelInterleaveRow &entry = d->m_interleaved.at(proxyIndex.row());
+        return d->m_sourceModels.at(entry.source)->index(entry.row, proxyIndex.column());
+    }
+
     const QAbstractItemModel *model = d->sourceModelByProxyRow(proxyIndex.row());
     if (model) {
         int newRow = proxyIndex.row() - d->offsetForModel(model);
+        if (d->isDeduplicating()) {
+            const int source = d->sourcePosition(model);
+            newRow = d->dedupRow(source, d->m_dedupSources.at(source).visibleLabels.at(newRow));
+        }
         return model->index(newRow, proxyIndex.column());
     }
     return QModelIndex();
@@ -568,6 +2850,29 @@ QModelIndex QMultiProxyModel::mapFromSource(const QModelIndex &sourceIndex) cons
     Q_ASSERT(sourceIndex.model() != this);
 
     Q_D(const QMultiProxyModel);
+    if (d->isInterleaving()) {
+        const int source = d->sourcePosition(sourceIndex.model());
+        const int row = source < 0 ? -1 : d->interleavePosition(source, sourceIndex.row());
+        return row < 0 ? QModelIndex() : createIndex(row, sourceIndex.column());
+    }
+    if (d->isDeduplicating()) {
+        const int source = d->sourcePosition(sourceIndex.model());
+        if (source < 0) {
+            return QModelIndex();
+        }
+        const QMultiProxyModelPrivate::DedupSource &entry = d->m_dedupSources.at(source);
+        if (sourceIndex.row() >= entry.labels.size()) {
+            return QModelIndex();
+        }
+        const qint64 label = entry.labels.at(sourceIndex.row());
+        const QVector<qint64> &visible = entry.visibleLabels;
+        QVector<qint64>::const_iterator it = std::lower_bound(visible.constBegin(), visible.constEnd(), label);
+        if (it == visible.constEnd() || *it != label) {
+            return QModelIndex();
+        }
+        return createIndex(d->offsetForPosition(source) + (it - visible.constBegin()), sourceIndex.column());
+    }
+
     int row = d->offsetForModel(sourceIndex.model()) + sourceIndex.row();
     return createIndex(row, sourceIndex.column());
 }
@@ -655,6 +2960,13 @@ int QMultiProxyModel::rowCount(const QModelIndex &parent) const
     Q_ASSERT(parent.isValid() ? parent.model() == this : true);
 
     Q_D(const QMultiProxyModel);
+    if (d->isInterleaving()) {
+        return parent.isValid() ? 0 : d->m_interleaved.size();
+    }
+    if (d->isDeduplicating()) {
+        return parent.isValid() ? 0 : d->offsetForPosition(d->m_sourceModels.size());
+    }
+
     int rowCountSum = 0;
     foreach (QAbstractItemModel *model, d->m_sourceModels) {
         rowCountSum += model->rowCount(parent);
@@ -704,4 +3016,157 @@ QHash<int, QByteArray> QMultiProxyModel::roleNames() const
 }
 #endif
 
+/*!
+    \class QMultiProxyModelSnapshot
+    \brief The QMultiProxyModelSnapshot class is an immutable view of the source models of a QMultiProxyModel.
+
+    Snapshots are obtained with QMultiProxyModel::readSnapshot() and can be used from any thread.
+    The rows of different source models can be read in parallel, for example one worker per source model.
+    Publishing, reading and releasing a snapshot use only sequentially consistent atomic operations,
+    so a snapshot is never deleted while another thread is still taking it.
+    \sa QMultiProxyModel::setReadSnapshotsEnabled()
+*/
+
+/*!
+ * \brief Constructs an invalid snapshot.
+ */
+QMultiProxyModelSnapshot::QMultiProxyModelSnapshot() : d(0)
+{
+}
+
+QMultiProxyModelSnapshot::QMultiProxyModelSnapshot(const QMultiProxyModelSnapshotData *data) : d(data)
+{
+    if (d) {
+        d->ref.ref();
+    }
+}
+
+QMultiProxyModelSnapshot::QMultiProxyModelSnapshot(const QMultiProxyModelSnapshot &other) : d(other.d)
+{
+    if (d) {
+        d->ref.ref();
+    }
+}
+
+/*!
+ * \brief Releases the snapshot. The data is deleted by the proxy model.
+ */
+QMultiProxyModelSnapshot::~QMultiProxyModelSnapshot()
+{
+    if (d) {
+        d->ref.deref();
+    }
+}
+
+QMultiProxyModelSnapshot &QMultiProxyModelSnapshot::operator=(const QMultiProxyModelSnapshot &other)
+{
+    if (other.d) {
+        other.d->ref.ref();
+    }
+    if (d) {
+        d->ref.deref();
+    }
+    d = other.d;
+    return *this;
+}
+
+bool QMultiProxyModelSnapshot::isValid() const
+{
+    return d != 0;
+}
+
+/*!
+ * \return Returns the number of proxy rows at the time the snapshot was published.
+ */
+int QMultiProxyModelSnapshot::rowCount() const
+{
+    return d ? d->offsets.at(d->offsets.size() - 1) : 0;
+}
+
+int QMultiProxyModelSnapshot::sourceModelCount() const
+{
+    return d ? d->sourceModels.size() : 0;
+}
+
+/*!
+ * \return Returns the source model at position \a source, or 0 if it's a deferred source model
+ * that had not been materialized when the snapshot was published.
+ */
+QAbstractItemModel *QMultiProxyModelSnapshot::sourceModel(int source) const
+{
+    return d ? d->sourceModels.at(source) : 0;
+}
+
+bool QMultiProxyModelSnapshot::isConcurrentReadSafe(int source) const
+{
+    return d ? d->concurrentReadSafe.at(source) : false;
+}
+
+/*!
+ * \return Returns the proxy row of the first row of the source model at position \a source.
+ * \note In the interleaved layout the rows of a source model are not contiguous; use sourceByProxyRow() instead.
+ */
+int QMultiProxyModelSnapshot::sourceOffset(int source) const
+{
+    return d ? d->offsets.at(source) : 0;
+}
+
+/*!
+ * \return Returns the number of proxy rows provided by the source model at position \a source.
+ */
+int QMultiProxyModelSnapshot::sourceRowCount(int source) const
+{
+    return d ? d->offsets.at(source + 1) - d->offsets.at(source) : 0;
+}
+
+/*!
+ * \return Returns the position of the source model that provides the given proxy \a row, or -1 if the row is out of range.
+ */
+int QMultiProxyModelSnapshot::sourceByProxyRow(int row) const
+{
+    if (!d || row < 0 || row >= d->offsets.at(d->offsets.size() - 1)) {
+        return -1;
+    }
+    if (!d->interleaved.isEmpty()) {
+        return d->interleaved.at(row).source;
+    }
+    return std::upper_bound(d->offsets.constBegin(), d->offsets.constEnd(), row) - d->offsets.constBegin() - 1;
+}
+
+/*!
+ * \return Returns the row of the source model that corresponds to the given proxy \a row, or -1 if the row is out of range.
+ */
+int QMultiProxyModelSnapshot::sourceRow(int row) const
+{
+    const int source = sourceByProxyRow(row);
+    if (source < 0) {
+        return -1;
+    }
+    if (!d->interleaved.isEmpty()) {
+        return d->interleaved.at(row).row;
+    }
+
+    const int localRow = row - d->offsets.at(source);
+    if (d->visibleLabels.isEmpty()) {
+        return localRow;
+    }
+    const QVector<qint64> &labels = d->labels.at(source);
+    return std::lower_bound(labels.constBegin(), labels.constEnd(), d->visibleLabels.at(source).at(localRow)) - labels.constBegin();
+}
+
+/*!
+ * \brief Reads the data of the given proxy \a row and \a column from the source model.
+ * \return Returns an invalid QVariant if the row is out of range or the source model is not marked as concurrent read safe.
+ */
+QVariant QMultiProxyModelSnapshot::data(int row, int column, int role) const
+{
+    const int source = sourceByProxyRow(row);
+    if (source < 0 || !d->concurrentReadSafe.at(source)) {
+        return QVariant();
+    }
+
+    const QAbstractItemModel *model = d->sourceModels.at(source);
+    return model->data(model->index(sourceRow(row), column), role);
+}
+
 #include "moc_qmultiproxymodel.cpp"
@@ -4,11 +4,64 @@
 #include <QAbstractProxyModel>
 
 class QMultiProxyModelPrivate;
+class QMultiProxyModelSnapshotData;
+
+/*!
+ * \brief The QMultiProxyModelDeferredSource class creates a source model on demand.
+ * The model returned by createSourceModel() is not owned by the proxy model; the deferred
+ * source or the application is responsible for deleting it.
+ * \sa QMultiProxyModel::addDeferredSourceModel()
+ */
+class QMultiProxyModelDeferredSource
+{
+public:
+    virtual ~QMultiProxyModelDeferredSource() {}
+
+    virtual int estimatedRowCount() const = 0;
+    virtual int estimatedColumnCount() const { return 1; }
+    virtual QAbstractItemModel *createSourceModel() = 0;
+};
+
+class QMultiProxyModelSnapshot
+{
+public:
+    QMultiProxyModelSnapshot();
+    QMultiProxyModelSnapshot(const QMultiProxyModelSnapshot &other);
+    ~QMultiProxyModelSnapshot();
+    QMultiProxyModelSnapshot &operator=(const QMultiProxyModelSnapshot &other);
+
+    bool isValid() const;
+    int rowCount() const;
+
+    int sourceModelCount() const;
+    QAbstractItemModel *sourceModel(int source) const;
+    bool isConcurrentReadSafe(int source) const;
+    int sourceOffset(int source) const;
+    int sourceRowCount(int source) const;
+
+    int sourceByProxyRow(int row) const;
+    int sourceRow(int row) const;
+    QVariant data(int row, int column, int role = Qt::DisplayRole) const;
+
+private:
+    explicit QMultiProxyModelSnapshot(const QMultiProxyModelSnapshotData *data);
+
+    const QMultiProxyModelSnapshotData *d;
+    friend class QMultiProxyModel;
+};
 
 class QMultiProxyModel : public QAbstractProxyModel
 {
     Q_OBJECT
 public:
+    enum AggregateType {
+        CountAggregate,
+        SumAggregate,
+        MinimumAggregate,
+        MaximumAggregate,
+        AverageAggregate
+    };
+
     explicit QMultiProxyModel(QObject *parent = 0);
     virtual ~QMultiProxyModel();
 
@@ -18,6 +71,26 @@ public:
     void clearSourceModelsList();
     bool containsSourceModel(QAbstractItemModel *model);
 
+    bool addDeferredSourceModel(QMultiProxyModelDeferredSource *source);
+    QAbstractItemModel *materializeDeferredSourceModel(QMultiProxyModelDeferredSource *source);
+    bool removeDeferredSourceModel(QMultiProxyModelDeferredSource *source);
+
+    void setDeduplicationRole(int role);
+    int deduplicationRole() const;
+
+    void setInterleaveRole(int role);
+    int interleaveRole() const;
+
+    int addAggregate(int column, int role, AggregateType type);
+    bool removeAggregate(int id);
+    QVariant aggregate(int id) const;
+
+    void setReadSnapshotsEnabled(bool enabled);
+    bool readSnapshotsEnabled() const;
+    bool setSourceModelConcurrentReadSafe(QAbstractItemModel *model, bool safe);
+    bool isSourceModelConcurrentReadSafe(QAbstractItemModel *model) const;
+    QMultiProxyModelSnapshot readSnapshot() const;
+
     virtual QVariant data(const QModelIndex &proxyIndex, int role) const;
     virtual QModelIndex mapToSource(const QModelIndex &proxyIndex) const;
     virtual QModelIndex mapFromSource(const QModelIndex &sourceIndex) const;
@@ -39,6 +112,8 @@ public:
 
 private:
     void setSourceModel(QAbstractItemModel *sourceModel) { Q_UNUSED(sourceModel)}
+    void connectSourceModel(QAbstractItemModel *model);
+    void disconnectSourceModel(QAbstractItemModel *model);
 
     QMultiProxyModelPrivate *const d_ptr;
     Q_DECLARE_PRIVATE(QMultiProxyModel)
@@ -60,6 +135,8 @@ private:
     Q_PRIVATE_SLOT(d_func(), void _q_modelAboutToBeReset())
     Q_PRIVATE_SLOT(d_func(), void _q_modelReset())
     Q_PRIVATE_SLOT(d_func(), void _q_headerDataChanged(Qt::Orientation,int,int))
+    Q_PRIVATE_SLOT(d_func(), void _q_materializeRequested())
+    Q_PRIVATE_SLOT(d_func(), void _q_publishSnapshot())
 
 #if QT_VERSION < 0x050000
     Q_PRIVATE_SLOT(d_func(), void _q_layoutAboutToBeChanged())
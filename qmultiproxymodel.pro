@@ -8,8 +8,16 @@ CONFIG += staticlib
 
 DEFINES += QMULTIPROXYMODEL_LIBRARY
 
-SOURCES += qmultiproxymodel.cpp
-HEADERS += qmultiproxymodel.h
+# Lets GCC and Clang vectorize the reduction of the aggregate blocks. No operation is reordered,
+# so the results are the same as without the flags.
+*g++*|*clang* {
+    QMAKE_CXXFLAGS += -ftree-vectorize -fno-trapping-math
+}
+
+SOURCES += qmultiproxymodel.cpp \
+    qcolumnartablemodel.cpp
+HEADERS += qmultiproxymodel.h \
+    qcolumnartablemodel.h
 
 unix {
     target.headers = /usr/include/qmultiproxymodel